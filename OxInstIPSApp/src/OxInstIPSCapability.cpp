@@ -0,0 +1,54 @@
+/* OxInstIPSCapability.cpp
+ *
+ * Capability profiles of the IPS models.  See OxInstIPSCapability.h.
+ */
+#include <ctype.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "OxInstIPSCapability.h"
+
+/* Most specific first; the last entry matches everything. */
+static const OxInstIPSCapabilities profiles[] = {
+    { "IPS120-10 v3",   "IPS120-10",    3.0, true,  true,  0 },
+    { "IPS120-20 v3",   "IPS120-20",    3.0, true,  true,  0 },
+    { "IPS120",         "IPS120",       0.0, false, false, -1 },
+    { "plain",          "",             0.0, false, false, -1 }
+};
+
+bool OxInstIPSParseVersion(const char *reply, char *model, size_t modelSize,
+                           const char **rest, double *version)
+{
+    const char *p = reply, *number;
+    size_t length;
+
+    while (isspace((unsigned char)*p)) p++;
+    length = strcspn(p, " \t");
+    if (length == 0) return false;
+    if (length >= modelSize) length = modelSize - 1;
+    memcpy(model, p, length);
+    model[length] = '\0';
+    p += strcspn(p, " \t");
+    while (isspace((unsigned char)*p)) p++;
+    *rest = p;
+    number = strstr(p, "Version");
+    *version = number ? strtod(number + strlen("Version"), NULL) : 0.0;
+    return true;
+}
+
+const OxInstIPSCapabilities &OxInstIPSFindCapabilities(const char *model, double version)
+{
+    const size_t count = sizeof(profiles) / sizeof(profiles[0]);
+
+    for (size_t i = 0; i < count - 1; i++) {
+        if (strncmp(model, profiles[i].model, strlen(profiles[i].model)) == 0 &&
+            version >= profiles[i].minVersion) return profiles[i];
+    }
+    return profiles[count - 1];
+}
+
+const OxInstIPSCapabilities &OxInstIPSDefaultCapabilities()
+{
+    return profiles[sizeof(profiles) / sizeof(profiles[0]) - 1];
+}
@@ -0,0 +1,49 @@
+/* OxInstIPSCapability.h
+ *
+ * What each IPS model and firmware version supports, so that the driver can use the
+ * fastest protocol variant a unit allows.  The driver reads V when it connects,
+ *   IPS120-10  Version 3.07  (c) OXFORD 1996
+ * and takes the first profile whose model prefix matches and whose minimum firmware
+ * version is met.  Units that do not answer, or are not listed, use the plain protocol
+ * the StreamDevice records use.
+ */
+#ifndef OxInstIPSCapability_H
+#define OxInstIPSCapability_H
+
+#include <stddef.h>
+
+#include "epicsTypes.h"
+
+/* Bit of Rn in a read mask. */
+#define OXINSTIPS_READ(n) ((epicsUInt32)1 << (n))
+
+/* R0-R2 and R5-R9 are polled; R16 and R18 are the persistent current and field; R15,
+ * R17, R19, R21 and R22 the voltage limit, trip current and field and current limits. */
+#define OXINSTIPS_READ_POLLED (OXINSTIPS_READ(0) | OXINSTIPS_READ(1) | OXINSTIPS_READ(2) | \
+                               OXINSTIPS_READ(5) | OXINSTIPS_READ(6) | OXINSTIPS_READ(7) | \
+                               OXINSTIPS_READ(8) | OXINSTIPS_READ(9))
+#define OXINSTIPS_READ_PERSISTENT (OXINSTIPS_READ(16) | OXINSTIPS_READ(18))
+#define OXINSTIPS_READ_LIMITS (OXINSTIPS_READ(15) | OXINSTIPS_READ(17) | OXINSTIPS_READ(19) | \
+                               OXINSTIPS_READ(21) | OXINSTIPS_READ(22))
+#define OXINSTIPS_READ_ALL (OXINSTIPS_READ_POLLED | OXINSTIPS_READ_PERSISTENT | OXINSTIPS_READ_LIMITS)
+
+struct OxInstIPSCapabilities {
+    const char *name;
+    const char *model;              /* prefix of the model in the V reply */
+    double minVersion;
+    bool extendedResolution;        /* Q4 gives an extra digit on R replies */
+    bool suppressReply;             /* a leading $ suppresses the reply to a command */
+    int minWait;                    /* safe W, ms between reply characters; -1 leaves it */
+};
+
+/* Splits a V reply into the model, the first word, and the rest; version is the number
+ * after "Version", 0 if there is none.  Returns false if the reply is empty. */
+bool OxInstIPSParseVersion(const char *reply, char *model, size_t modelSize,
+                           const char **rest, double *version);
+
+const OxInstIPSCapabilities &OxInstIPSFindCapabilities(const char *model, double version);
+
+/* The profile used until V has been read. */
+const OxInstIPSCapabilities &OxInstIPSDefaultCapabilities();
+
+#endif /* OxInstIPSCapability_H */
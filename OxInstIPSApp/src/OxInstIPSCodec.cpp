@@ -0,0 +1,324 @@
+/* OxInstIPSCodec.cpp
+ *
+ * Compact encoding of OxInstIPSHistorySample streams.  See OxInstIPSCodec.h.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "epicsTime.h"
+#include "iocsh.h"
+
+#include "OxInstIPSCodec.h"
+#include "OxInstIPSHistory.h"
+
+#include "epicsExport.h"
+
+/* Sample header bits. */
+#define OXINSTIPS_CODEC_STATUS_VALID 0x01
+#define OXINSTIPS_CODEC_STATUS       0x02
+#define OXINSTIPS_CODEC_MASK         0x04
+
+/* Values beyond this are not representable in fixed point and are stored as invalid. */
+#define OXINSTIPS_CODEC_MAX_FIXED 4.0e15
+
+static size_t putVarint(unsigned char *out, epicsUInt64 value)
+{
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (unsigned char)value;
+    return n;
+}
+
+static size_t getVarint(const unsigned char *in, size_t size, epicsUInt64 *value)
+{
+    epicsUInt64 result = 0;
+
+    for (size_t n = 0; n < size && n < 10; n++) {
+        result |= (epicsUInt64)(in[n] & 0x7f) << (7 * n);
+        if ((in[n] & 0x80) == 0) {
+            *value = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+static epicsUInt64 zigzag(epicsInt64 value)
+{
+    return ((epicsUInt64)value << 1) ^ (epicsUInt64)(value >> 63);
+}
+
+static epicsInt64 unzigzag(epicsUInt64 value)
+{
+    return (epicsInt64)(value >> 1) ^ -(epicsInt64)(value & 1);
+}
+
+void OxInstIPSSampleEncoder::reset(epicsUInt64 startTime)
+{
+    lastTime_ = startTime;
+    lastDelta_ = 0;
+    memset(last_, 0, sizeof(last_));
+    lastMask_ = 0;
+    memset(lastStatus_, 0, sizeof(lastStatus_));
+    lastStatusValid_ = false;
+    first_ = true;
+}
+
+size_t OxInstIPSSampleEncoder::encode(const OxInstIPSHistorySample &sample, unsigned char *out)
+{
+    epicsInt64 fixed[OXINSTIPS_HISTORY_VALUES];
+    epicsUInt8 mask = 0;
+    epicsUInt8 header = 0;
+    size_t n = 1;
+
+    for (int i = 0; i < OXINSTIPS_HISTORY_VALUES; i++) {
+        double scaled = sample.values[i] * OXINSTIPS_CODEC_SCALE;
+        if (fabs(scaled) < OXINSTIPS_CODEC_MAX_FIXED) {      /* false for NaN */
+            fixed[i] = (epicsInt64)floor(scaled + 0.5);
+            mask |= (epicsUInt8)(1 << i);
+        }
+    }
+    if (sample.statusValid) header |= OXINSTIPS_CODEC_STATUS_VALID;
+    if (first_ || (sample.statusValid && (!lastStatusValid_ ||
+                   memcmp(sample.status, lastStatus_, sizeof(lastStatus_)) != 0))) {
+        header |= OXINSTIPS_CODEC_STATUS;
+    }
+    if (first_ || mask != lastMask_) header |= OXINSTIPS_CODEC_MASK;
+
+    out[0] = header;
+    if (header & OXINSTIPS_CODEC_MASK) out[n++] = mask;
+
+    epicsInt64 delta = (epicsInt64)(sample.time - lastTime_);
+    n += putVarint(out + n, zigzag(delta - lastDelta_));
+    lastTime_ = sample.time;
+    lastDelta_ = delta;
+
+    for (int i = 0; i < OXINSTIPS_HISTORY_VALUES; i++) {
+        if ((mask & (1 << i)) == 0) continue;
+        n += putVarint(out + n, zigzag(fixed[i] - last_[i]));
+        last_[i] = fixed[i];
+    }
+
+    if (header & OXINSTIPS_CODEC_STATUS) {
+        for (int i = 0; i < OXINSTIPS_HISTORY_STATUS; i += 2) {
+            epicsUInt8 high = (i + 1 < OXINSTIPS_HISTORY_STATUS) ? sample.status[i + 1] : 0;
+            out[n++] = (unsigned char)((sample.status[i] & 0x0f) | ((high & 0x0f) << 4));
+        }
+        memcpy(lastStatus_, sample.status, sizeof(lastStatus_));
+    }
+    lastStatusValid_ = (sample.statusValid != 0);
+    lastMask_ = mask;
+    first_ = false;
+    return n;
+}
+
+void OxInstIPSSampleDecoder::reset(epicsUInt64 startTime)
+{
+    lastTime_ = startTime;
+    lastDelta_ = 0;
+    memset(last_, 0, sizeof(last_));
+    lastMask_ = 0;
+    memset(lastStatus_, 0, sizeof(lastStatus_));
+    lastStatusValid_ = false;
+}
+
+size_t OxInstIPSSampleDecoder::decode(const unsigned char *in, size_t size, OxInstIPSHistorySample *sample)
+{
+    epicsUInt64 raw;
+    size_t n = 1, used;
+
+    if (size < 1) return 0;
+    epicsUInt8 header = in[0];
+    if (header & OXINSTIPS_CODEC_MASK) {
+        if (size < 2) return 0;
+        lastMask_ = in[n++];
+    }
+
+    if ((used = getVarint(in + n, size - n, &raw)) == 0) return 0;
+    n += used;
+    lastDelta_ += unzigzag(raw);
+    lastTime_ += (epicsUInt64)lastDelta_;
+    sample->time = lastTime_;
+
+    for (int i = 0; i < OXINSTIPS_HISTORY_VALUES; i++) {
+        if ((lastMask_ & (1 << i)) == 0) {
+            sample->values[i] = NAN;
+            continue;
+        }
+        if ((used = getVarint(in + n, size - n, &raw)) == 0) return 0;
+        n += used;
+        last_[i] += unzigzag(raw);
+        sample->values[i] = (double)last_[i] / OXINSTIPS_CODEC_SCALE;
+    }
+
+    if (header & OXINSTIPS_CODEC_STATUS) {
+        if (size - n < (OXINSTIPS_HISTORY_STATUS + 1) / 2) return 0;
+        for (int i = 0; i < OXINSTIPS_HISTORY_STATUS; i += 2) {
+            lastStatus_[i] = in[n] & 0x0f;
+            if (i + 1 < OXINSTIPS_HISTORY_STATUS) lastStatus_[i + 1] = in[n] >> 4;
+            n++;
+        }
+    }
+    memcpy(sample->status, lastStatus_, sizeof(lastStatus_));
+    sample->statusValid = (header & OXINSTIPS_CODEC_STATUS_VALID) ? 1 : 0;
+    return n;
+}
+
+/* Benchmark on simulated sweeps.  The magnet ramps between setpoints at a fixed rate,
+ * polled about once a second with a few ms of jitter, with the readback noise and
+ * reply resolution of a real unit. */
+
+static epicsUInt32 benchmarkRandom(epicsUInt32 *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static double benchmarkNoise(epicsUInt32 *state)
+{
+    return (benchmarkRandom(state) / (double)(1u << 24)) - 0.5;
+}
+
+/* Nearest double to the decimal reply, as parsing the reply would give. */
+static double benchmarkRound(double value, int places)
+{
+    double scale = pow(10.0, places);
+    return floor(value * scale + 0.5) / scale;
+}
+
+static void benchmarkSamples(std::vector<OxInstIPSHistorySample> *samples, size_t count)
+{
+    static const double setpoints[] = { 0.0, 50.0, 120.0, -40.0, 0.0, 10.0 };
+    static const int numSetpoints = sizeof(setpoints) / sizeof(setpoints[0]);
+    const double teslaPerAmp = 0.05, rate = 2.0;    /* A/min */
+    epicsUInt32 seed = 12345;
+    epicsUInt64 time = (epicsUInt64)1000000000u * 1000000000u;
+    double current = 0.0;
+    int next = 1, hold = 0;
+
+    samples->resize(count);
+    for (size_t n = 0; n < count; n++) {
+        OxInstIPSHistorySample &s = (*samples)[n];
+        double setpoint = setpoints[next];
+        bool sweeping = (current != setpoint);
+
+        time += 1000000000u + (epicsUInt64)(benchmarkNoise(&seed) * 8e6 + 4e6);
+        if (sweeping) {
+            double step = rate / 60.0;
+            current = (fabs(setpoint - current) <= step) ? setpoint
+                    : current + (setpoint > current ? step : -step);
+        } else if (++hold > 120) {
+            next = (next + 1) % numSetpoints;
+            hold = 0;
+        }
+
+        memset(&s, 0, sizeof(s));
+        s.time = time;
+        s.values[0] = benchmarkRound(current, 3);
+        s.values[1] = benchmarkRound((sweeping ? 1.5 : 0.0) + 0.02 * benchmarkNoise(&seed), 2);
+        s.values[2] = benchmarkRound(current + 0.004 * benchmarkNoise(&seed), 3);
+        s.values[3] = benchmarkRound(setpoint, 3);
+        s.values[4] = rate;
+        s.values[5] = benchmarkRound(current * teslaPerAmp, 4);
+        s.values[6] = benchmarkRound(setpoint * teslaPerAmp, 4);
+        s.values[7] = benchmarkRound(rate * teslaPerAmp, 4);
+        /* An occasional failed read. */
+        if (benchmarkRandom(&seed) % 1000 == 0) s.values[1] = NAN;
+        s.status[2] = 1;
+        s.status[3] = 3;
+        s.status[6] = sweeping ? 1 : 0;
+        s.statusValid = 1;
+    }
+}
+
+static bool benchmarkSame(const OxInstIPSHistorySample &a, const OxInstIPSHistorySample &b)
+{
+    if (a.time != b.time || a.statusValid != b.statusValid) return false;
+    for (int i = 0; i < OXINSTIPS_HISTORY_VALUES; i++) {
+        if (isnan(a.values[i]) != isnan(b.values[i])) return false;
+        if (!isnan(a.values[i]) && a.values[i] != b.values[i]) return false;
+    }
+    return !a.statusValid || memcmp(a.status, b.status, sizeof(a.status)) == 0;
+}
+
+extern "C" {
+
+int OxInstIPSCodecBenchmark(int count)
+{
+    std::vector<OxInstIPSHistorySample> samples, decoded;
+    std::vector<unsigned char> buffer;
+    std::vector<size_t> runStarts;
+    OxInstIPSSampleEncoder encoder;
+    OxInstIPSSampleDecoder decoder;
+    epicsTimeStamp t0, t1, t2;
+    size_t bytes = 0, mismatches = 0;
+
+    if (count <= 0) count = 1000000;
+    benchmarkSamples(&samples, (size_t)count);
+    buffer.resize(samples.size() * OXINSTIPS_CODEC_MAX_BYTES);
+    decoded.resize(samples.size());
+
+    /* Runs of OXINSTIPS_HISTORY_BLOCK_SAMPLES, as in the history file. */
+    epicsTimeGetCurrent(&t0);
+    for (size_t n = 0; n < samples.size(); n++) {
+        if (n % OXINSTIPS_HISTORY_BLOCK_SAMPLES == 0) {
+            encoder.reset(samples[n].time);
+            runStarts.push_back(bytes);
+        }
+        bytes += encoder.encode(samples[n], &buffer[bytes]);
+    }
+    epicsTimeGetCurrent(&t1);
+    size_t offset = 0;
+    for (size_t n = 0; n < samples.size(); n++) {
+        if (n % OXINSTIPS_HISTORY_BLOCK_SAMPLES == 0) decoder.reset(samples[n].time);
+        size_t used = decoder.decode(&buffer[offset], bytes - offset, &decoded[n]);
+        if (used == 0) break;
+        offset += used;
+    }
+    epicsTimeGetCurrent(&t2);
+
+    for (size_t n = 0; n < samples.size(); n++) {
+        if (!benchmarkSame(samples[n], decoded[n])) mismatches++;
+    }
+
+    double encodeTime = epicsTimeDiffInSeconds(&t1, &t0);
+    double decodeTime = epicsTimeDiffInSeconds(&t2, &t1);
+    double rawBytes = (double)samples.size() * sizeof(OxInstIPSHistorySample);
+    printf("OxInstIPSCodecBenchmark: %lu samples, %lu runs\n",
+           (unsigned long)samples.size(), (unsigned long)runStarts.size());
+    printf("  size    %.0f -> %lu bytes, %.2f bytes/sample, ratio %.2f\n",
+           rawBytes, (unsigned long)bytes, (double)bytes / samples.size(), rawBytes / bytes);
+    if (encodeTime > 0.0 && decodeTime > 0.0) {
+        printf("  encode  %.3f s, %.2f Msamples/s, %.1f MB/s raw\n",
+               encodeTime, samples.size() / encodeTime / 1e6, rawBytes / encodeTime / 1e6);
+        printf("  decode  %.3f s, %.2f Msamples/s, %.1f MB/s raw\n",
+               decodeTime, samples.size() / decodeTime / 1e6, rawBytes / decodeTime / 1e6);
+    }
+    printf("  round trip %s (%lu mismatches)\n", mismatches ? "FAILED" : "exact", (unsigned long)mismatches);
+    return mismatches ? -1 : 0;
+}
+
+static const iocshArg benchmarkArg0 = { "samples", iocshArgInt };
+static const iocshArg * const benchmarkArgs[] = { &benchmarkArg0 };
+static const iocshFuncDef benchmarkFuncDef = { "OxInstIPSCodecBenchmark", 1, benchmarkArgs };
+
+static void benchmarkCallFunc(const iocshArgBuf *args)
+{
+    OxInstIPSCodecBenchmark(args[0].ival);
+}
+
+void OxInstIPSCodecRegister(void)
+{
+    iocshRegister(&benchmarkFuncDef, benchmarkCallFunc);
+}
+
+epicsExportRegistrar(OxInstIPSCodecRegister);
+
+}
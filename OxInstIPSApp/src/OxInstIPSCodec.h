@@ -0,0 +1,86 @@
+/* OxInstIPSCodec.h
+ *
+ * Compact encoding of OxInstIPSHistorySample streams.
+ *
+ * IPS readbacks are decimal replies with at most five places, so each value is stored
+ * as a fixed-point integer in units of 1/OXINSTIPS_CODEC_SCALE, which is lossless for
+ * anything the unit can report.  Each sample stores the zigzag varint difference from
+ * the previous valid value of the same channel, and the time as the varint
+ * delta-of-delta of the sample times, so a steady poll costs a byte or two.  The validity
+ * mask and the X status digits (packed two per byte) are only written when they change.
+ *
+ * The first sample after reset() is encoded against zero, so a run of samples starting
+ * at a reset can be decoded on its own.  A typical sample takes 12-20 bytes against the
+ * 80 of OxInstIPSHistorySample.
+ *
+ * The benchmark can be run from the IOC shell with
+ *   OxInstIPSCodecBenchmark(samples)
+ * and testApp/OxInstIPSCodecTest checks the round trip.
+ */
+#ifndef OxInstIPSCodec_H
+#define OxInstIPSCodec_H
+
+#include <stddef.h>
+
+#include "epicsTypes.h"
+
+#define OXINSTIPS_HISTORY_VALUES 8          /* R0 R1 R2 R5 R6 R7 R8 R9 */
+#define OXINSTIPS_HISTORY_STATUS 7          /* X m n, A, C, H, M m n */
+#define OXINSTIPS_HISTORY_CHANNELS (OXINSTIPS_HISTORY_VALUES + OXINSTIPS_HISTORY_STATUS)
+
+/* One poll.  Values that could not be read are stored as NaN. */
+struct OxInstIPSHistorySample {
+    epicsUInt64 time;                                   /* ns since the EPICS epoch */
+    epicsFloat64 values[OXINSTIPS_HISTORY_VALUES];
+    epicsUInt8 status[OXINSTIPS_HISTORY_STATUS];
+    epicsUInt8 statusValid;
+};
+
+#define OXINSTIPS_CODEC_SCALE 100000.0
+
+/* Largest encoding of one sample: header, mask, time and values as 10 byte varints,
+ * and the packed status. */
+#define OXINSTIPS_CODEC_MAX_BYTES (2 + 10 * (1 + OXINSTIPS_HISTORY_VALUES) + (OXINSTIPS_HISTORY_STATUS + 1) / 2)
+
+class OxInstIPSSampleEncoder {
+public:
+    OxInstIPSSampleEncoder() { reset(0); }
+
+    /* Start a new run whose first sample is at or after startTime (ns since the EPICS epoch). */
+    void reset(epicsUInt64 startTime);
+
+    /* Encode one sample into out, which must have OXINSTIPS_CODEC_MAX_BYTES free.
+     * Sample times must not decrease.  Returns the number of bytes written. */
+    size_t encode(const OxInstIPSHistorySample &sample, unsigned char *out);
+
+private:
+    epicsUInt64 lastTime_;
+    epicsInt64 lastDelta_;
+    epicsInt64 last_[OXINSTIPS_HISTORY_VALUES];
+    epicsUInt8 lastMask_;
+    epicsUInt8 lastStatus_[OXINSTIPS_HISTORY_STATUS];
+    bool lastStatusValid_;
+    bool first_;
+};
+
+class OxInstIPSSampleDecoder {
+public:
+    OxInstIPSSampleDecoder() { reset(0); }
+
+    /* Must be given the same startTime as the encoder was for this run. */
+    void reset(epicsUInt64 startTime);
+
+    /* Decode one sample from at most size bytes.  Returns the number of bytes used, or
+     * 0 if the data is truncated or corrupt. */
+    size_t decode(const unsigned char *in, size_t size, OxInstIPSHistorySample *sample);
+
+private:
+    epicsUInt64 lastTime_;
+    epicsInt64 lastDelta_;
+    epicsInt64 last_[OXINSTIPS_HISTORY_VALUES];
+    epicsUInt8 lastMask_;
+    epicsUInt8 lastStatus_[OXINSTIPS_HISTORY_STATUS];
+    bool lastStatusValid_;
+};
+
+#endif /* OxInstIPSCodec_H */
@@ -0,0 +1,1989 @@
+/* OxInstIPSDriver.cpp
+ *
+ * asyn port driver for the Oxford Instruments IPS superconducting magnet power supply.
+ * See OxInstIPSDriver.h and the IPS Operators Handbook for the protocol.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+#include "epicsStdio.h"
+#include "epicsThread.h"
+#include "epicsTime.h"
+#include "iocsh.h"
+#include "asynOctetSyncIO.h"
+
+#include "OxInstIPSDriver.h"
+#include "OxInstIPSParse.h"
+#include "OxInstIPSTrace.h"
+
+#include "epicsExport.h"
+
+static const char *driverName = "OxInstIPSDriver";
+
+/* Same as the replytimeout of the StreamDevice protocol. */
+#define OXINSTIPS_REPLY_TIMEOUT 5.0
+
+#define OXINSTIPS_DEFAULT_SETTLE_WINDOW 5
+
+#define OXINSTIPS_DEFAULT_STATS_WINDOW 60.0
+
+/* A cycle normally takes well under a second; one reply timeout means the unit is not
+ * answering. */
+#define OXINSTIPS_DEFAULT_POLL_DEADLINE OXINSTIPS_REPLY_TIMEOUT
+
+/* A read due this soon is taken now, as the wait before it may end a clock tick early. */
+#define OXINSTIPS_SCHEDULE_SLACK 0.02
+
+/* Shed parameters are polled this many times less often. */
+#define OXINSTIPS_SHED_FACTOR 10.0
+
+/* Cycles without overload before one priority is restored. */
+#define OXINSTIPS_SHED_RECOVER_CYCLES 20
+
+/* Time for the persistent switch to open or close after the heater changes. */
+#define OXINSTIPS_DEFAULT_HEATER_TIME 20.0
+
+/* A unit that does not answer V is asked again this often, s. */
+#define OXINSTIPS_DETECT_RETRY 60.0
+
+/* The setpoint limits change only from the front panel, so are read this often, s. */
+#define OXINSTIPS_LIMITS_PERIOD 60.0
+
+/* Demand current, A, above which R7/R0 gives the field constant. */
+#define OXINSTIPS_FIELD_CONSTANT_CURRENT 1.0
+
+/* How often the watchdog checks that the poll loop is still cycling. */
+#define OXINSTIPS_WATCHDOG_PERIOD 1.0
+
+const OxInstIPSDriver::ReadParam OxInstIPSDriver::readParams_[OxInstIPSDriver::NumReadParams] = {
+    { 0, P_DemandCurrentString,    &OxInstIPSDriver::P_DemandCurrent,
+         &OxInstIPSDriver::P_CurrentSweepRate, &OxInstIPSDriver::P_SetpointCurrent,
+         &OxInstIPSDriver::P_SettleCurrentTol, false, PriorityCritical },
+    { 1, P_SupplyVoltageString,    &OxInstIPSDriver::P_SupplyVoltage,    NULL, NULL, NULL, true, PriorityDiagnostic },
+    { 2, P_MeasuredCurrentString,  &OxInstIPSDriver::P_MeasuredCurrent,  NULL, NULL, NULL, true, PriorityCritical },
+    { 5, P_SetpointCurrentString,  &OxInstIPSDriver::P_SetpointCurrent,  NULL, NULL, NULL, false, PriorityConfig },
+    { 6, P_CurrentSweepRateString, &OxInstIPSDriver::P_CurrentSweepRate, NULL, NULL, NULL, false, PriorityConfig },
+    { 7, P_DemandFieldString,      &OxInstIPSDriver::P_DemandField,
+         &OxInstIPSDriver::P_FieldSweepRate, &OxInstIPSDriver::P_SetpointField,
+         &OxInstIPSDriver::P_SettleFieldTol, false, PriorityCritical },
+    { 8, P_SetpointFieldString,    &OxInstIPSDriver::P_SetpointField,    NULL, NULL, NULL, false, PriorityConfig },
+    { 9, P_FieldSweepRateString,   &OxInstIPSDriver::P_FieldSweepRate,   NULL, NULL, NULL, false, PriorityConfig },
+};
+
+const OxInstIPSDriver::ConfigItem OxInstIPSDriver::configItems_[OxInstIPSDriver::NumConfigItems] = {
+    { 'S', 6, &OxInstIPSDriver::P_CurrentSweepRate, &OxInstIPSDriver::P_ConfigCurrentRate,
+              &OxInstIPSModelInfo::currentRateDecimals },
+    { 'T', 9, &OxInstIPSDriver::P_FieldSweepRate,   &OxInstIPSDriver::P_ConfigFieldRate,
+              &OxInstIPSModelInfo::fieldRateDecimals },
+    { 'I', 5, &OxInstIPSDriver::P_SetpointCurrent,  &OxInstIPSDriver::P_ConfigSetCurrent,
+              &OxInstIPSModelInfo::currentDecimals },
+    { 'J', 8, &OxInstIPSDriver::P_SetpointField,    &OxInstIPSDriver::P_ConfigSetField,
+              &OxInstIPSModelInfo::fieldDecimals },
+};
+
+/* Drivers are never deleted. */
+static epicsMutex driversMutex;
+static std::vector<OxInstIPSDriver *> driverList;
+
+static void pollTaskC(void *drvPvt)
+{
+    OxInstIPSDriver *pPvt = (OxInstIPSDriver *)drvPvt;
+    pPvt->pollTask();
+}
+
+static void estimateTaskC(void *drvPvt)
+{
+    OxInstIPSDriver *pPvt = (OxInstIPSDriver *)drvPvt;
+    pPvt->estimateTask();
+}
+
+static void watchdogTaskC(void *drvPvt)
+{
+    OxInstIPSDriver *pPvt = (OxInstIPSDriver *)drvPvt;
+    pPvt->watchdogTask();
+}
+
+OxInstIPSDriver::OxInstIPSDriver(const char *portName, const char *serialPort, double pollPeriod, double commandGap,
+                                 const OxInstIPSModelInfo &model)
+    : asynPortDriver(portName, 1,
+                     asynInt32Mask | asynFloat64Mask | asynFloat64ArrayMask | asynOctetMask | asynDrvUserMask,
+                     asynInt32Mask | asynFloat64Mask | asynFloat64ArrayMask | asynOctetMask,
+                     ASYN_CANBLOCK, 1, 0, 0),
+      pasynUserSerial_(NULL), pollPeriod_(pollPeriod), commandGap_(commandGap), model_(model),
+      pollEvent_(epicsEventMustCreate(epicsEventEmpty)),
+      estimateEvent_(epicsEventMustCreate(epicsEventEmpty)),
+      settle_(OXINSTIPS_DEFAULT_SETTLE_WINDOW), waiterAllocations_(0),
+      historyMaxPoints_(0), sweeping_(false),
+      pollCycles_(0), pollOverruns_(0), pollLatency_(0.0), pollStalled_(false),
+      allocatingCycles_(0),
+      schedule_(), pollMisses_(0), shedFrom_(NumPriorities), calmCycles_(0),
+      caps_(&OxInstIPSDefaultCapabilities()), capsKnown_(false), extendedResolution_(false),
+      limits_(), fieldConstant_(0.0), setpointRejects_(0),
+      commsWait_(-1), configMask_(0), configRestore_(false),
+      seqSteps_(NULL), seqId_(OxInstIPSSequenceNone), seqStep_(0), seqWaiting_(false), seqAbort_(false),
+      holdPending_(false)
+{
+    static const char *functionName = "OxInstIPSDriver";
+    asynStatus status;
+
+    for (size_t i = 0; i < NumReadParams; i++) {
+        createParam(readParams_[i].name, asynParamFloat64, &(this->*readParams_[i].index));
+    }
+    createParam(P_SystemFaultString,        asynParamInt32,   &P_SystemFault);
+    createParam(P_SystemLimitString,        asynParamInt32,   &P_SystemLimit);
+    createParam(P_ActivityString,           asynParamInt32,   &P_Activity);
+    createParam(P_ControlString,            asynParamInt32,   &P_Control);
+    createParam(P_HeaterString,             asynParamInt32,   &P_Heater);
+    createParam(P_SweepModeString,          asynParamInt32,   &P_SweepMode);
+    createParam(P_SweepStatusString,        asynParamInt32,   &P_SweepStatus);
+    createParam(P_SettledString,            asynParamInt32,   &P_Settled);
+    createParam(P_SettleWindowString,       asynParamInt32,   &P_SettleWindow);
+    createParam(P_SettleCurrentTolString,   asynParamFloat64, &P_SettleCurrentTol);
+    createParam(P_SettleFieldTolString,     asynParamFloat64, &P_SettleFieldTol);
+    createParam(P_SettleTimeoutString,      asynParamFloat64, &P_SettleTimeout);
+    createParam(P_SettleCurrentNoiseString, asynParamFloat64, &P_SettleCurrentNoise);
+    createParam(P_SettleFieldNoiseString,   asynParamFloat64, &P_SettleFieldNoise);
+    createParam(P_MoveTimeoutString,        asynParamFloat64, &P_MoveTimeout);
+    createParam(P_MovesActiveString,        asynParamInt32,   &P_MovesActive);
+    createParam(P_EstimatePeriodString,     asynParamFloat64, &P_EstimatePeriod);
+    createParam(P_EstDemandCurrentString,   asynParamFloat64, &P_EstDemandCurrent);
+    createParam(P_EstDemandFieldString,     asynParamFloat64, &P_EstDemandField);
+    createParam(P_EstimatedString,          asynParamInt32,   &P_Estimated);
+    createParam(P_FiltCurrentString,        asynParamFloat64, &P_FiltCurrent);
+    createParam(P_FiltVarianceString,       asynParamFloat64, &P_FiltVariance);
+    createParam(P_FiltMeasNoiseString,      asynParamFloat64, &P_FiltMeasNoise);
+    createParam(P_FiltRestNoiseString,      asynParamFloat64, &P_FiltRestNoise);
+    createParam(P_FiltSweepNoiseString,     asynParamFloat64, &P_FiltSweepNoise);
+    createParam(P_HistSamplesString,        asynParamInt32,   &P_HistSamples);
+    createParam(P_HistChannelString,        asynParamInt32,   &P_HistChannel);
+    createParam(P_HistStartString,          asynParamFloat64, &P_HistStart);
+    createParam(P_HistEndString,            asynParamFloat64, &P_HistEnd);
+    createParam(P_HistDecimationString,     asynParamInt32,   &P_HistDecimation);
+    createParam(P_HistQueryString,          asynParamInt32,   &P_HistQuery);
+    createParam(P_HistPointsString,         asynParamInt32,   &P_HistPoints);
+    createParam(P_HistQueryTimeString,      asynParamFloat64, &P_HistQueryTime);
+    createParam(P_HistTimesString,          asynParamFloat64Array, &P_HistTimes);
+    createParam(P_HistValuesString,         asynParamFloat64Array, &P_HistValues);
+    createParam(P_HistResolutionString,     asynParamInt32,   &P_HistResolution);
+    createParam(P_HistBucketString,         asynParamFloat64, &P_HistBucket);
+    createParam(P_HistMinString,            asynParamFloat64Array, &P_HistMin);
+    createParam(P_HistMaxString,            asynParamFloat64Array, &P_HistMax);
+    createParam(P_StatsWindowString,        asynParamFloat64, &P_StatsWindow);
+    createParam(P_StaleString,              asynParamInt32,   &P_Stale);
+    createParam(P_StaleTimeoutString,       asynParamFloat64, &P_StaleTimeout);
+    createParam(P_PollCyclesString,         asynParamInt32,   &P_PollCycles);
+    createParam(P_PollLatencyString,        asynParamFloat64, &P_PollLatency);
+    createParam(P_PollJitterString,         asynParamFloat64, &P_PollJitter);
+    createParam(P_PollDeadlineString,       asynParamFloat64, &P_PollDeadline);
+    createParam(P_PollOverrunsString,       asynParamInt32,   &P_PollOverruns);
+    createParam(P_PollAliveString,          asynParamInt32,   &P_PollAlive);
+    createParam(P_PollMissesString,         asynParamInt32,   &P_PollMisses);
+    createParam(P_PollDeferredString,       asynParamInt32,   &P_PollDeferred);
+    createParam(P_PollShedString,           asynParamInt32,   &P_PollShed);
+    createParam(P_ModelString,              asynParamOctet,   &P_Model);
+    createParam(P_VersionString,            asynParamOctet,   &P_Version);
+    createParam(P_FirmwareString,           asynParamFloat64, &P_Firmware);
+    createParam(P_ProfileString,            asynParamOctet,   &P_Profile);
+    createParam(P_LimitNegCurrentString,    asynParamFloat64, &P_LimitNegCurrent);
+    createParam(P_LimitPosCurrentString,    asynParamFloat64, &P_LimitPosCurrent);
+    createParam(P_TripCurrentString,        asynParamFloat64, &P_TripCurrent);
+    createParam(P_TripFieldString,          asynParamFloat64, &P_TripField);
+    createParam(P_FieldConstantString,      asynParamFloat64, &P_FieldConstant);
+    createParam(P_SetpointRejectsString,    asynParamInt32,   &P_SetpointRejects);
+    createParam(P_ConfigSaveString,         asynParamInt32,   &P_ConfigSave);
+    createParam(P_ConfigRestoreString,      asynParamInt32,   &P_ConfigRestore);
+    createParam(P_ConfigStateString,        asynParamInt32,   &P_ConfigState);
+    createParam(P_ConfigMismatchesString,   asynParamInt32,   &P_ConfigMismatches);
+    createParam(P_ConfigSweepModeString,    asynParamInt32,   &P_ConfigSweepMode);
+    createParam(P_ConfigCurrentRateString,  asynParamFloat64, &P_ConfigCurrentRate);
+    createParam(P_ConfigFieldRateString,    asynParamFloat64, &P_ConfigFieldRate);
+    createParam(P_ConfigSetCurrentString,   asynParamFloat64, &P_ConfigSetCurrent);
+    createParam(P_ConfigSetFieldString,     asynParamFloat64, &P_ConfigSetField);
+    createParam(P_ConfigWaitString,         asynParamInt32,   &P_ConfigWait);
+    createParam(P_ConfigMaskString,         asynParamInt32,   &P_ConfigMask);
+    createParam(P_SeqStartString,           asynParamInt32,   &P_SeqStart);
+    createParam(P_SeqAbortString,           asynParamInt32,   &P_SeqAbort);
+    createParam(P_SeqStateString,           asynParamInt32,   &P_SeqState);
+    createParam(P_SeqStepString,            asynParamInt32,   &P_SeqStep);
+    createParam(P_SeqHeaterTimeString,      asynParamFloat64, &P_SeqHeaterTime);
+    createParam(P_SeqTargetString,          asynParamFloat64, &P_SeqTarget);
+    createParam(P_SeqRateString,            asynParamFloat64, &P_SeqRate);
+    for (size_t i = 0; i < NumReadParams; i++) {
+        std::string name(readParams_[i].name);
+        createParam((name + OXINSTIPS_STATS_MIN_SUFFIX).c_str(),    asynParamFloat64, &P_StatsMin[i]);
+        createParam((name + OXINSTIPS_STATS_MAX_SUFFIX).c_str(),    asynParamFloat64, &P_StatsMax[i]);
+        createParam((name + OXINSTIPS_STATS_MEAN_SUFFIX).c_str(),   asynParamFloat64, &P_StatsMean[i]);
+        createParam((name + OXINSTIPS_STATS_STDDEV_SUFFIX).c_str(), asynParamFloat64, &P_StatsStddev[i]);
+        createParam((name + OXINSTIPS_POLL_PERIOD_SUFFIX).c_str(),  asynParamFloat64, &P_PollPeriod[i]);
+        createParam((name + OXINSTIPS_POLL_ACTUAL_SUFFIX).c_str(),  asynParamFloat64, &P_PollActual[i]);
+        createParam((name + OXINSTIPS_POLL_LATE_SUFFIX).c_str(),    asynParamFloat64, &P_PollLate[i]);
+    }
+
+    setIntegerParam(P_Settled, 0);
+    setIntegerParam(P_SettleWindow, OXINSTIPS_DEFAULT_SETTLE_WINDOW);
+    setDoubleParam(P_SettleCurrentTol, 0.0);
+    setDoubleParam(P_SettleFieldTol, 0.0);
+    setDoubleParam(P_SettleTimeout, 0.0);
+    setDoubleParam(P_SettleCurrentNoise, 0.0);
+    setDoubleParam(P_SettleFieldNoise, 0.0);
+    setDoubleParam(P_MoveTimeout, 0.0);
+    setIntegerParam(P_MovesActive, 0);
+    setDoubleParam(P_EstimatePeriod, 0.0);
+    setIntegerParam(P_Estimated, 0);
+    setDoubleParam(P_FiltMeasNoise, 0.0);
+    setDoubleParam(P_FiltRestNoise, 0.0);
+    setDoubleParam(P_FiltSweepNoise, 0.0);
+    setIntegerParam(P_HistSamples, 0);
+    setIntegerParam(P_HistChannel, 0);
+    setDoubleParam(P_HistStart, 0.0);
+    setDoubleParam(P_HistEnd, 0.0);
+    setIntegerParam(P_HistDecimation, 1);
+    setIntegerParam(P_HistPoints, 0);
+    setDoubleParam(P_HistQueryTime, 0.0);
+    setIntegerParam(P_HistResolution, 0);
+    setDoubleParam(P_HistBucket, 0.0);
+    setDoubleParam(P_StatsWindow, OXINSTIPS_DEFAULT_STATS_WINDOW);
+    for (size_t i = 0; i < NumReadParams; i++) stats_[i].setWindow(OXINSTIPS_DEFAULT_STATS_WINDOW);
+    waiters_.reserve(OXINSTIPS_WAITERS);
+    setIntegerParam(P_Stale, 0);
+    setDoubleParam(P_StaleTimeout, 0.0);
+    setIntegerParam(P_PollCycles, 0);
+    setDoubleParam(P_PollLatency, 0.0);
+    setDoubleParam(P_PollJitter, 0.0);
+    setDoubleParam(P_PollDeadline, OXINSTIPS_DEFAULT_POLL_DEADLINE);
+    setIntegerParam(P_PollOverruns, 0);
+    setIntegerParam(P_PollAlive, 0);
+    setIntegerParam(P_PollMisses, 0);
+    setIntegerParam(P_PollDeferred, 0);
+    setIntegerParam(P_PollShed, 0);
+    setStringParam(P_Model, "");
+    setStringParam(P_Version, "");
+    setDoubleParam(P_Firmware, 0.0);
+    setStringParam(P_Profile, caps_->name);
+    for (size_t i = 0; i < NumReadParams; i++) {
+        if (!isSupported(i)) setParamStatus(this->*readParams_[i].index, asynDisabled);
+    }
+    setDoubleParam(P_FieldConstant, 0.0);
+    setIntegerParam(P_SetpointRejects, 0);
+    setIntegerParam(P_ConfigState, OxInstIPSConfigEmpty);
+    setIntegerParam(P_ConfigMismatches, 0);
+    /* The values and mask of the configuration set are left undefined, so that output
+     * records read back what autosave restored into them rather than a default. */
+    setIntegerParam(P_SeqState, OxInstIPSSequenceIdle);
+    setIntegerParam(P_SeqStep, 0);
+    setDoubleParam(P_SeqHeaterTime, OXINSTIPS_DEFAULT_HEATER_TIME);
+    setDoubleParam(P_SeqTarget, 0.0);
+    setDoubleParam(P_SeqRate, 0.0);
+    epicsTimeGetCurrent(&pollCycleEnd_);
+    cycleDue_ = pollCycleEnd_;
+    detectDue_ = pollCycleEnd_;
+    limitsDue_ = pollCycleEnd_;
+    for (size_t i = 0; i < NumReadParams; i++) {
+        setDoubleParam(P_PollPeriod[i], 0.0);
+        setDoubleParam(P_PollActual[i], 0.0);
+        setDoubleParam(P_PollLate[i], 0.0);
+        schedule_[i].due = pollCycleEnd_;
+    }
+
+    status = pasynOctetSyncIO->connect(serialPort, 0, &pasynUserSerial_, NULL);
+    if (status != asynSuccess) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: cannot connect to serial port %s\n",
+            driverName, functionName, serialPort);
+        return;
+    }
+    pasynOctetSyncIO->setInputEos(pasynUserSerial_, "\r", 1);
+    pasynOctetSyncIO->setOutputEos(pasynUserSerial_, "\r", 1);
+
+    driversMutex.lock();
+    driverList.push_back(this);
+    driversMutex.unlock();
+    unit_ = OxInstIPSUnitTable::instance().addUnit(portName);
+
+    if (epicsThreadCreate("OxInstIPSPoll",
+                          epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          (EPICSTHREADFUNC)pollTaskC, this) == NULL ||
+        epicsThreadCreate("OxInstIPSEstimate",
+                          epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackSmall),
+                          (EPICSTHREADFUNC)estimateTaskC, this) == NULL ||
+        epicsThreadCreate("OxInstIPSWatchdog",
+                          epicsThreadPriorityHigh,
+                          epicsThreadGetStackSize(epicsThreadStackSmall),
+                          (EPICSTHREADFUNC)watchdogTaskC, this) == NULL) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: epicsThreadCreate failure\n", driverName, functionName);
+    }
+}
+
+/* Send one command and read its reply.  The IPS echoes the command letter at the
+ * start of a successful reply and answers '?' followed by the command on error. */
+asynStatus OxInstIPSDriver::transact(const char *command, char *reply, size_t replySize)
+{
+    static const char *functionName = "transact";
+    size_t nwrite = 0, nread = 0;
+    int eomReason;
+    asynStatus status;
+    epicsTimeStamp sent, received, done;
+    OxInstIPSCounters::Outcome outcome;
+
+    OXINSTIPS_TRACE2(send, portName, command);
+    epicsTimeGetCurrent(&sent);
+    status = pasynOctetSyncIO->writeRead(pasynUserSerial_, command, strlen(command),
+                                         reply, replySize - 1, OXINSTIPS_REPLY_TIMEOUT,
+                                         &nwrite, &nread, &eomReason);
+    epicsTimeGetCurrent(&received);
+    OXINSTIPS_TRACE4(reply, portName, command, (int)status, nread);
+    reply[status == asynSuccess ? nread : 0] = '\0';
+    if (commandGap_ > 0) epicsThreadSleep(commandGap_);
+    epicsTimeGetCurrent(&done);
+    if (status == asynTimeout) outcome = OxInstIPSCounters::OutcomeTimeout;
+    else if (status != asynSuccess) outcome = OxInstIPSCounters::OutcomeError;
+    else if (reply[0] == '?') outcome = OxInstIPSCounters::OutcomeRejected;
+    else outcome = OxInstIPSCounters::OutcomeOk;
+    counters_.addTransaction(outcome, epicsTimeDiffInSeconds(&received, &sent),
+                             epicsTimeDiffInSeconds(&done, &sent));
+    if (status != asynSuccess) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: %s: command %s failed, status=%d\n",
+            driverName, functionName, portName, command, status);
+        return status;
+    }
+    if (reply[0] == '?') {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: %s: command %s rejected: %s\n",
+            driverName, functionName, portName, command, reply);
+        return asynError;
+    }
+    return asynSuccess;
+}
+
+/* Send a set command, preceded by C3 (remote and unlocked) as in OxInstIPS.protocol.
+ * The reply to a successful set command is the command letter. */
+asynStatus OxInstIPSDriver::sendCommand(const char *command)
+{
+    OxInstIPSTransaction *transaction = transactions_.allocate();
+    char *reply = transaction->reply;
+    asynStatus status;
+
+    if (caps_->suppressReply) status = sendSuppressed("$C3");
+    else status = transact("C3", reply, sizeof(transaction->reply));
+    if (status == asynSuccess) status = transact(command, reply, sizeof(transaction->reply));
+    if (status == asynSuccess && reply[0] != command[0]) status = asynError;
+    transactions_.release(transaction);
+    return status;
+}
+
+/* Send a command starting with $, to which the IPS does not reply.  Only for units
+ * whose profile has suppressReply. */
+asynStatus OxInstIPSDriver::sendSuppressed(const char *command)
+{
+    static const char *functionName = "sendSuppressed";
+    size_t nwrite = 0;
+    asynStatus status;
+    epicsTimeStamp sent, written, done;
+
+    OXINSTIPS_TRACE2(send, portName, command);
+    epicsTimeGetCurrent(&sent);
+    status = pasynOctetSyncIO->write(pasynUserSerial_, command, strlen(command),
+                                     OXINSTIPS_REPLY_TIMEOUT, &nwrite);
+    epicsTimeGetCurrent(&written);
+    if (commandGap_ > 0) epicsThreadSleep(commandGap_);
+    epicsTimeGetCurrent(&done);
+    counters_.addTransaction(status == asynSuccess ? OxInstIPSCounters::OutcomeOk :
+                             status == asynTimeout ? OxInstIPSCounters::OutcomeTimeout :
+                                                     OxInstIPSCounters::OutcomeError,
+                             epicsTimeDiffInSeconds(&written, &sent),
+                             epicsTimeDiffInSeconds(&done, &sent));
+    if (status != asynSuccess) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: %s: command %s failed, status=%d\n",
+            driverName, functionName, portName, command, status);
+    }
+    return status;
+}
+
+/* Read the model and firmware with V and choose the capability profile, then switch the
+ * unit to the fastest protocol variant it allows.  Runs on the poll thread at the start of
+ * a cycle until the unit has answered.  The unit forgets Q and W when power cycled, which
+ * is harmless: replies parse the same at either resolution, and a set command with one
+ * digit too many has it ignored. */
+void OxInstIPSDriver::detectCapabilities()
+{
+    static const char *functionName = "detectCapabilities";
+    OxInstIPSTransaction *transaction = transactions_.allocate();
+    char model[40];
+    const char *rest = "";
+    double version = 0.0;
+    int wait = -1;
+    bool extended = false;
+    asynStatus status;
+
+    status = transact("V", transaction->reply, sizeof(transaction->reply));
+    if (status == asynSuccess &&
+        !OxInstIPSParseVersion(transaction->reply, model, sizeof(model), &rest, &version)) {
+        counters_.addParseError();
+        status = asynError;
+    }
+    if (status != asynSuccess) {
+        transactions_.release(transaction);
+        epicsTimeGetCurrent(&detectDue_);
+        epicsTimeAddSeconds(&detectDue_, OXINSTIPS_DETECT_RETRY);
+        return;
+    }
+
+    const OxInstIPSCapabilities &caps = OxInstIPSFindCapabilities(model, version);
+    if (caps.suppressReply) {
+        sendSuppressed("$C3");
+        if (caps.extendedResolution) extended = sendSuppressed("$Q4") == asynSuccess;
+        if (caps.minWait >= 0) {
+            epicsSnprintf(transaction->command, sizeof(transaction->command), "$W%d", caps.minWait);
+            if (sendSuppressed(transaction->command) == asynSuccess) wait = caps.minWait;
+        }
+    }
+    asynPrint(pasynUserSelf, ASYN_TRACE_FLOW,
+        "%s:%s: %s: %s firmware %g, profile %s\n",
+        driverName, functionName, portName, model, version, caps.name);
+
+    lock();
+    caps_ = &caps;
+    capsKnown_ = true;
+    extendedResolution_ = extended;
+    if (wait >= 0) commsWait_ = wait;
+    setStringParam(P_Model, model);
+    setStringParam(P_Version, rest);
+    setDoubleParam(P_Firmware, version);
+    setStringParam(P_Profile, caps.name);
+    callParamCallbacks();
+    unlock();
+    transactions_.release(transaction);
+}
+
+/* Rn is read only if the model has it. */
+bool OxInstIPSDriver::hasRead(int command) const
+{
+    return (model_.readMask & OXINSTIPS_READ(command)) != 0;
+}
+
+/* Digits after the point in a set command: the model's at extended resolution, one fewer
+ * at the normal resolution the unit starts in, so that the value is rounded by the driver
+ * rather than cut short by the unit. */
+int OxInstIPSDriver::setDecimals(int OxInstIPSModelInfo::*decimals) const
+{
+    return model_.*decimals - (extendedResolution_ ? 0 : 1);
+}
+
+bool OxInstIPSDriver::isSupported(size_t param) const
+{
+    return hasRead(readParams_[param].command);
+}
+
+/* Read the current limits and trip values that setpoints are checked against.  Runs on
+ * the poll thread at the start of a cycle every OXINSTIPS_LIMITS_PERIOD.  If any read
+ * fails the limits already held are kept. */
+void OxInstIPSDriver::readLimits()
+{
+    static const int commands[] = { 21, 22, 17, 19 };
+    const size_t count = sizeof(commands) / sizeof(commands[0]);
+    OxInstIPSTransaction *transaction = transactions_.allocate();
+    double values[count];
+    bool ok = true;
+
+    for (size_t k = 0; k < count && ok; k++) {
+        values[k] = 0.0;
+        if (!hasRead(commands[k])) continue;
+        ok = readParameter(commands[k], transaction) == asynSuccess &&
+             transaction->reply[0] == 'R' && OxInstIPSParseNumber(transaction->reply + 1, &values[k]);
+    }
+    transactions_.release(transaction);
+    epicsTimeGetCurrent(&limitsDue_);
+    epicsTimeAddSeconds(&limitsDue_, OXINSTIPS_LIMITS_PERIOD);
+    if (!ok) return;
+
+    lock();
+    limits_.known = hasRead(21) && hasRead(22);
+    limits_.negCurrent = values[0];
+    limits_.posCurrent = values[1];
+    limits_.tripCurrent = values[2];
+    limits_.tripField = values[3];
+    setDoubleParam(P_LimitNegCurrent, limits_.negCurrent);
+    setDoubleParam(P_LimitPosCurrent, limits_.posCurrent);
+    setDoubleParam(P_TripCurrent, limits_.tripCurrent);
+    setDoubleParam(P_TripField, limits_.tripField);
+    callParamCallbacks();
+    unlock();
+}
+
+/* Called with the driver locked after every poll cycle.  The field constant is the ratio
+ * of demand field to demand current, once the current is far enough from zero. */
+void OxInstIPSDriver::updateFieldConstant()
+{
+    double current, field;
+    asynStatus currentStatus, fieldStatus;
+
+    getParamStatus(P_DemandCurrent, &currentStatus);
+    getParamStatus(P_DemandField, &fieldStatus);
+    if (currentStatus != asynSuccess || fieldStatus != asynSuccess) return;
+    getDoubleParam(P_DemandCurrent, &current);
+    getDoubleParam(P_DemandField, &field);
+    if (fabs(current) < OXINSTIPS_FIELD_CONSTANT_CURRENT || field / current <= 0.0) return;
+    fieldConstant_ = field / current;
+    setDoubleParam(P_FieldConstant, fieldConstant_);
+}
+
+bool OxInstIPSDriver::currentAllowed(double current) const
+{
+    if (limits_.known && (current < -fabs(limits_.negCurrent) || current > fabs(limits_.posCurrent))) return false;
+    if (model_.maxCurrent > 0.0 && fabs(current) > model_.maxCurrent) return false;
+    return limits_.tripCurrent <= 0.0 || fabs(current) < limits_.tripCurrent;
+}
+
+/* Called with the driver locked.  Checks a setpoint (I, J) or sweep rate (S, T) before it
+ * is sent, rather than have the IPS answer '?' a round trip later.  Currents must be
+ * within the R21 and R22 limits and the model's maximum, and below the last trip current
+ * R17 if there has been a trip; fields are also held below R19 and checked as currents
+ * through the field constant once it is known.  Rates must be positive. */
+asynStatus OxInstIPSDriver::checkSetpoint(char command, double value)
+{
+    static const char *functionName = "checkSetpoint";
+    bool ok = isfinite(value);
+
+    if (ok && command == 'I') {
+        ok = currentAllowed(value);
+    } else if (ok && command == 'J') {
+        ok = (limits_.tripField <= 0.0 || fabs(value) < limits_.tripField) &&
+             (fieldConstant_ <= 0.0 || currentAllowed(value / fieldConstant_));
+    } else if (ok) {
+        ok = value > 0.0;
+    }
+    if (ok) return asynSuccess;
+    setpointRejects_++;
+    setIntegerParam(P_SetpointRejects, (int)setpointRejects_);
+    asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+        "%s:%s: %s: %c%g refused, outside the limits\n", driverName, functionName, portName, command, value);
+    return asynError;
+}
+
+/* Called with the driver locked.  Copies the readbacks of the rates, setpoints and sweep
+ * mode into the configuration set, with the last wait interval the driver sent.  Values
+ * the unit does not report are left out; a readback that has failed fails the save. */
+asynStatus OxInstIPSDriver::saveConfig()
+{
+    unsigned mask = 0;
+    asynStatus status;
+    double value;
+    int mode;
+
+    for (size_t i = 0; i < NumConfigItems; i++) {
+        if (!hasRead(configItems_[i].read)) continue;
+        getParamStatus(this->*configItems_[i].readback, &status);
+        if (status != asynSuccess) return asynError;
+        mask |= 1u << i;
+    }
+    getParamStatus(P_SweepMode, &status);
+    if (status != asynSuccess) return asynError;
+    mask |= 1u << NumConfigItems;
+
+    for (size_t i = 0; i < NumConfigItems; i++) {
+        if (!(mask & (1u << i))) continue;
+        getDoubleParam(this->*configItems_[i].readback, &value);
+        setDoubleParam(this->*configItems_[i].saved, value);
+    }
+    getIntegerParam(P_SweepMode, &mode);
+    setIntegerParam(P_ConfigSweepMode, mode);
+    if (commsWait_ >= 0) setIntegerParam(P_ConfigWait, commsWait_);
+    setConfigMask(mask);
+    return asynSuccess;
+}
+
+/* Called with the driver locked.  The mask is a record of its own so that autosave
+ * restores it, after the values, and a restore works after a reboot. */
+void OxInstIPSDriver::setConfigMask(unsigned mask)
+{
+    configMask_ = mask & ((2u << NumConfigItems) - 1);
+    setIntegerParam(P_ConfigMask, (int)configMask_);
+    if (!configRestore_) {
+        setIntegerParam(P_ConfigState, configMask_ ? OxInstIPSConfigSaved : OxInstIPSConfigEmpty);
+    }
+}
+
+/* Called with the driver locked.  The restore runs on the poll thread, and only with the
+ * sweep on hold and no move or sequence running, since new setpoints take effect at once
+ * when the unit is sweeping to set point. */
+asynStatus OxInstIPSDriver::requestRestore()
+{
+    asynStatus activityStatus;
+    int activity, wait = -1;
+
+    getParamStatus(P_Activity, &activityStatus);
+    getIntegerParam(P_Activity, &activity);
+    getIntegerParam(P_ConfigWait, &wait);
+    if ((configMask_ == 0 && wait < 0) || configRestore_ || seqSteps_ != NULL ||
+        activityStatus != asynSuccess || activity != OXINSTIPS_ACTIVITY_HOLD) return asynError;
+    for (size_t i = 0; i < waiters_.size(); i++) {
+        if (waiters_[i]->condition != OxInstIPSWaitSettle) return asynError;
+    }
+    configRestore_ = true;
+    setIntegerParam(P_ConfigState, OxInstIPSConfigRestoring);
+    epicsEventSignal(pollEvent_);
+    return asynSuccess;
+}
+
+/* Half a unit in the last place of a reply, e.g. 0.005 for R+1.23. */
+static double replyResolution(const char *reply)
+{
+    const char *point = strchr(reply, '.');
+    double resolution = 0.5;
+
+    if (point == NULL) return resolution;
+    for (point++; *point >= '0' && *point <= '9'; point++) resolution /= 10.0;
+    return resolution;
+}
+
+/* Runs on the poll thread at the start of each cycle, and restores the configuration set
+ * if asked to: the setpoints are checked against the limits, everything is sent in one
+ * burst behind a single C3, and then read back once and compared with what was sent to
+ * the resolution of the command and of the reply.  The wait interval has no readback. */
+void OxInstIPSDriver::restoreConfig()
+{
+    static const char *functionName = "restoreConfig";
+    char commands[NumConfigItems + 2][OXINSTIPS_COMMAND_SIZE];
+    double saved[NumConfigItems], readback[NumConfigItems];
+    bool read[NumConfigItems];
+    unsigned mask;
+    int mode = 0, wait = -1, mismatches = 0;
+    size_t count = 0;
+    asynStatus result = asynSuccess, statusResult;
+    Status status;
+
+    lock();
+    if (!configRestore_) {
+        unlock();
+        return;
+    }
+    /* A value autosave did not restore is left out. */
+    mask = configMask_;
+    if (getIntegerParam(P_ConfigSweepMode, &mode) != asynSuccess) mask &= ~(1u << NumConfigItems);
+    getIntegerParam(P_ConfigWait, &wait);
+    if (mask & (1u << NumConfigItems)) {
+        epicsSnprintf(commands[count++], OXINSTIPS_COMMAND_SIZE, "M%d", mode);
+    }
+    for (size_t i = 0; i < NumConfigItems; i++) {
+        const ConfigItem &item = configItems_[i];
+        if (!(mask & (1u << i))) continue;
+        if (getDoubleParam(this->*item.saved, &saved[i]) != asynSuccess) {
+            mask &= ~(1u << i);
+            continue;
+        }
+        if (checkSetpoint(item.command, saved[i]) != asynSuccess) result = asynError;
+        epicsSnprintf(commands[count++], OXINSTIPS_COMMAND_SIZE, "%c%#.*f",
+                      item.command, setDecimals(item.decimals), saved[i]);
+    }
+    if (wait >= 0) epicsSnprintf(commands[count++], OXINSTIPS_COMMAND_SIZE, "W%d", wait);
+    callParamCallbacks();
+    unlock();
+
+    if (result == asynSuccess) result = sendBurst(commands, count);
+
+    /* One read pass to verify. */
+    OxInstIPSTransaction *transaction = transactions_.allocate();
+    for (size_t i = 0; i < NumConfigItems; i++) {
+        const ConfigItem &item = configItems_[i];
+        read[i] = false;
+        if (result != asynSuccess || !(mask & (1u << i)) || !hasRead(item.read)) continue;
+        read[i] = readParameter(item.read, transaction) == asynSuccess &&
+                  transaction->reply[0] == 'R' &&
+                  OxInstIPSParseNumber(transaction->reply + 1, &readback[i]);
+        if (!read[i] || fabs(readback[i] - saved[i]) >
+                replyResolution(transaction->reply) + 0.5 * pow(10.0, -setDecimals(item.decimals))) {
+            mismatches++;
+        }
+    }
+    transactions_.release(transaction);
+    statusResult = asynError;
+    if (result == asynSuccess && (mask & (1u << NumConfigItems))) {
+        statusResult = readStatus(&status);
+        if (statusResult != asynSuccess || status.sweepMode != mode) mismatches++;
+    }
+    if (result != asynSuccess || mismatches > 0) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: %s: restore failed, status=%d, %d values not read back as sent\n",
+            driverName, functionName, portName, result, mismatches);
+    }
+
+    lock();
+    if (result == asynSuccess && wait >= 0) commsWait_ = wait;
+    for (size_t i = 0; i < NumConfigItems; i++) {
+        if (!read[i]) continue;
+        setDoubleParam(this->*configItems_[i].readback, readback[i]);
+        setParamStatus(this->*configItems_[i].readback, asynSuccess);
+    }
+    if (statusResult == asynSuccess) publishStatus(statusResult, status);
+    configRestore_ = false;
+    setIntegerParam(P_ConfigMismatches, mismatches);
+    setIntegerParam(P_ConfigState, result == asynSuccess && mismatches == 0 ?
+                    OxInstIPSConfigRestored : OxInstIPSConfigFailed);
+    callParamCallbacks();
+    unlock();
+}
+
+/* Send set commands one after another behind a single C3, with $ so that no reply is
+ * waited for if the profile allows.  Otherwise each reply is checked and the burst stops
+ * at the first command refused. */
+asynStatus OxInstIPSDriver::sendBurst(const char (*commands)[OXINSTIPS_COMMAND_SIZE], size_t count)
+{
+    OxInstIPSTransaction *transaction = transactions_.allocate();
+    char *reply = transaction->reply;
+    asynStatus status;
+
+    if (caps_->suppressReply) {
+        status = sendSuppressed("$C3");
+        for (size_t k = 0; k < count && status == asynSuccess; k++) {
+            epicsSnprintf(transaction->command, sizeof(transaction->command), "$%s", commands[k]);
+            status = sendSuppressed(transaction->command);
+        }
+    } else {
+        status = transact("C3", reply, sizeof(transaction->reply));
+        for (size_t k = 0; k < count && status == asynSuccess; k++) {
+            status = transact(commands[k], reply, sizeof(transaction->reply));
+            if (status == asynSuccess && reply[0] != commands[k][0]) status = asynError;
+        }
+    }
+    transactions_.release(transaction);
+    return status;
+}
+
+asynStatus OxInstIPSDriver::readParameter(int command, OxInstIPSTransaction *transaction)
+{
+    epicsSnprintf(transaction->command, sizeof(transaction->command), "R%d", command);
+    return transact(transaction->command, transaction->reply, sizeof(transaction->reply));
+}
+
+/* Convert the replies of the parameters read this cycle together; see OxInstIPSParse.h. */
+void OxInstIPSDriver::parseParameters(OxInstIPSTransaction *const *reads, const bool *polled,
+                                      asynStatus *valueStatus, double *values)
+{
+    const char *lines[NumReadParams];
+    double parsed[NumReadParams];
+    bool ok[NumReadParams];
+    size_t index[NumReadParams], count = 0;
+
+    for (size_t i = 0; i < NumReadParams; i++) {
+        if (!polled[i] || valueStatus[i] != asynSuccess) continue;
+        if (reads[i]->reply[0] != 'R') {
+            valueStatus[i] = asynError;
+            counters_.addParseError();
+            continue;
+        }
+        lines[count] = reads[i]->reply + 1;
+        index[count++] = i;
+    }
+    OxInstIPSParseBatch(lines, count, parsed, ok);
+    for (size_t k = 0; k < count; k++) {
+        size_t i = index[k];
+        if (ok[k]) {
+            values[i] = parsed[k];
+        } else {
+            valueStatus[i] = asynError;
+            counters_.addParseError();
+        }
+    }
+    for (size_t i = 0; i < NumReadParams; i++) {
+        if (polled[i]) OXINSTIPS_TRACE3(parse, portName, reads[i]->command, (int)valueStatus[i]);
+    }
+}
+
+/* Reply is XmnAnCnHnMmnPmn - see the X command in OxInstIPS.protocol. */
+asynStatus OxInstIPSDriver::readStatus(Status *status)
+{
+    OxInstIPSTransaction *transaction = transactions_.allocate();
+    const char *reply = transaction->reply;
+    asynStatus result;
+
+    result = transact("X", transaction->reply, sizeof(transaction->reply));
+    if (result != asynSuccess) {
+        transactions_.release(transaction);
+        return result;
+    }
+    if (sscanf(reply, "X%1d%1dA%1dC%1dH%1dM%1d%1d",
+               &status->fault, &status->limit, &status->activity, &status->control,
+               &status->heater, &status->sweepMode, &status->sweepStatus) != 7) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:readStatus: %s: unexpected reply %s\n", driverName, portName, reply);
+        counters_.addParseError();
+        result = asynError;
+    }
+    OXINSTIPS_TRACE3(parse, portName, "X", (int)result);
+    transactions_.release(transaction);
+    return result;
+}
+
+void OxInstIPSDriver::publishStatus(asynStatus result, const Status &status)
+{
+    const int params[] = { P_SystemFault, P_SystemLimit, P_Activity, P_Control,
+                           P_Heater, P_SweepMode, P_SweepStatus };
+    const int values[] = { status.fault, status.limit, status.activity, status.control,
+                           status.heater, status.sweepMode, status.sweepStatus };
+
+    for (size_t i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+        if (result == asynSuccess) setIntegerParam(params[i], values[i]);
+        setParamStatus(params[i], result);
+    }
+    OxInstIPSUnitTable &table = OxInstIPSUnitTable::instance();
+    table.lockColumn(OXINSTIPS_UNIT_FAULT);
+    table.fault(unit_) = result == asynSuccess ? status.fault : -1.0;
+    table.unlockColumn(OXINSTIPS_UNIT_FAULT);
+}
+
+void OxInstIPSDriver::updateSettle(bool valid, const Status &status)
+{
+    double measuredCurrent, demandCurrent, demandField;
+    int settled;
+
+    if (!valid) {
+        settle_.reset();
+    } else {
+        getDoubleParam(P_MeasuredCurrent, &measuredCurrent);
+        getDoubleParam(P_DemandCurrent, &demandCurrent);
+        getDoubleParam(P_DemandField, &demandField);
+        settle_.addSample(measuredCurrent, demandCurrent, demandField,
+                          status.sweepStatus == OXINSTIPS_SWEEP_AT_REST);
+        for (size_t i = 0; i < waiters_.size(); i++) waiters_[i]->samplesSeen++;
+    }
+    settled = settle_.isSettled() ? 1 : 0;
+    setIntegerParam(P_Settled, settled);
+    setDoubleParam(P_SettleCurrentNoise, settle_.currentNoise());
+    setDoubleParam(P_SettleFieldNoise, settle_.fieldNoise());
+}
+
+bool OxInstIPSDriver::waiterDone(OxInstIPSWaiter *waiter, const Status &status, bool settled)
+{
+    double demand, tolerance;
+    bool atRest = (status.sweepStatus == OXINSTIPS_SWEEP_AT_REST);
+
+    if (waiter->condition == OxInstIPSWaitSettle) {
+        return settled && waiter->samplesSeen >= settle_.window();
+    }
+    if (waiter->cancelled) {
+        waiter->failed = true;
+        return true;
+    }
+    if (!waiter->started) return false;
+    if (waiter->failed) return true;
+
+    if (!waiter->reached) {
+        if (waiter->condition == OxInstIPSWaitFieldTarget) {
+            getDoubleParam(P_DemandField, &demand);
+            getDoubleParam(P_SettleFieldTol, &tolerance);
+        } else {
+            getDoubleParam(P_DemandCurrent, &demand);
+            getDoubleParam(P_SettleCurrentTol, &tolerance);
+        }
+        if (atRest && fabs(demand - waiter->target) <= tolerance) {
+            waiter->reached = true;
+            waiter->samplesSeen = 0;
+        } else if (status.activity != OXINSTIPS_ACTIVITY_TO_SET_POINT) {
+            /* Someone else has put the unit on hold, to zero or clamped it. */
+            waiter->failed = true;
+            return true;
+        }
+    }
+    if (!waiter->reached) return false;
+    return !waiter->settle || (settled && waiter->samplesSeen >= settle_.window());
+}
+
+/* Called with the driver locked after every poll cycle. */
+void OxInstIPSDriver::completeWaiters(const Status &status)
+{
+    epicsTimeStamp now;
+    int settled;
+    int moves = 0;
+
+    getIntegerParam(P_Settled, &settled);
+    epicsTimeGetCurrent(&now);
+    for (std::vector<OxInstIPSWaiter *>::iterator it = waiters_.begin(); it != waiters_.end(); ) {
+        OxInstIPSWaiter *waiter = *it;
+        bool done = waiterDone(waiter, status, settled != 0);
+        waiter->timedOut = !done && waiter->hasDeadline &&
+                           epicsTimeDiffInSeconds(&now, &waiter->deadline) >= 0.0;
+        if (done || waiter->timedOut) {
+            it = waiters_.erase(it);
+            if (waiter->complete) waiter->complete(waiter);
+            else callbackRequestProcessCallback(&waiter->callback, priorityMedium, waiter->precord);
+        } else {
+            if (waiter->condition != OxInstIPSWaitSettle) moves++;
+            ++it;
+        }
+    }
+    setIntegerParam(P_MovesActive, moves);
+}
+
+/* Called with the driver locked. */
+void OxInstIPSDriver::queueWaiter(OxInstIPSWaiter *waiter, double timeout)
+{
+    waiter->samplesSeen = 0;
+    waiter->started = false;
+    waiter->reached = false;
+    waiter->timedOut = false;
+    waiter->failed = false;
+    waiter->cancelled = false;
+    waiter->hasDeadline = (timeout > 0.0);
+    if (waiter->hasDeadline) {
+        epicsTimeGetCurrent(&waiter->deadline);
+        epicsTimeAddSeconds(&waiter->deadline, timeout);
+    }
+    if (waiters_.size() == waiters_.capacity()) waiterAllocations_++;
+    waiters_.push_back(waiter);
+    OXINSTIPS_TRACE2(enqueue, portName, waiter->condition == OxInstIPSWaitSettle ? "settle" : "setpoint");
+}
+
+asynStatus OxInstIPSDriver::addSettleWaiter(OxInstIPSWaiter *waiter)
+{
+    double timeout;
+
+    lock();
+    getDoubleParam(P_SettleTimeout, &timeout);
+    waiter->condition = OxInstIPSWaitSettle;
+    queueWaiter(waiter, timeout);
+    unlock();
+    return asynSuccess;
+}
+
+asynStatus OxInstIPSDriver::addSetpointWaiter(OxInstIPSWaiter *waiter, double target)
+{
+    double timeout;
+
+    if (checkSetpointWaiter(waiter, target) != asynSuccess) return asynError;
+    lock();
+    getDoubleParam(P_MoveTimeout, &timeout);
+    waiter->target = target;
+    queueWaiter(waiter, timeout);
+    unlock();
+    /* Start the move now rather than at the end of the poll period. */
+    epicsEventSignal(pollEvent_);
+    return asynSuccess;
+}
+
+asynStatus OxInstIPSDriver::checkSetpointWaiter(const OxInstIPSWaiter *waiter, double target)
+{
+    bool field = (waiter->condition == OxInstIPSWaitFieldTarget);
+    asynStatus status = asynSuccess;
+
+    if (waiter->condition == OxInstIPSWaitSettle) return asynError;
+    lock();
+    if (checkSetpoint(field ? 'J' : 'I', target) != asynSuccess ||
+        (waiter->rate > 0.0 && checkSetpoint(field ? 'T' : 'S', waiter->rate) != asynSuccess)) {
+        status = asynError;
+    }
+    callParamCallbacks();
+    unlock();
+    return status;
+}
+
+/* The poll thread sends the hold, after any setpoint it was about to send. */
+void OxInstIPSDriver::cancelSetpointWaiter(OxInstIPSWaiter *waiter)
+{
+    lock();
+    if (std::find(waiters_.begin(), waiters_.end(), waiter) != waiters_.end()) {
+        waiter->cancelled = true;
+        if (waiter->started) holdPending_ = true;
+    }
+    unlock();
+    epicsEventSignal(pollEvent_);
+}
+
+bool OxInstIPSDriver::isWaiterQueued(OxInstIPSWaiter *waiter)
+{
+    bool queued;
+
+    lock();
+    queued = std::find(waiters_.begin(), waiters_.end(), waiter) != waiters_.end();
+    unlock();
+    return queued;
+}
+
+asynStatus OxInstIPSDriver::getDemandField(double *field)
+{
+    asynStatus status;
+
+    lock();
+    status = getDoubleParam(P_DemandField, field);
+    if (status == asynSuccess) getParamStatus(P_DemandField, &status);
+    unlock();
+    return status;
+}
+
+/* Send the sweep rate, setpoint and "To Set Point" for moves queued since the last cycle.
+ * Runs on the poll thread so record processing never waits for the serial line. */
+void OxInstIPSDriver::startMoves()
+{
+    OxInstIPSWaiter *pending[OXINSTIPS_WAITERS];
+    size_t count = 0;
+
+    /* Moves beyond OXINSTIPS_WAITERS start on the next cycle. */
+    lock();
+    for (size_t i = 0; i < waiters_.size() && count < OXINSTIPS_WAITERS; i++) {
+        if (waiters_[i]->condition != OxInstIPSWaitSettle && !waiters_[i]->started) {
+            pending[count++] = waiters_[i];
+        }
+    }
+    unlock();
+    if (count == 0) return;
+
+    /* Only the poll thread removes waiters, so the pointers stay valid unlocked. */
+    OxInstIPSTransaction *transaction = transactions_.allocate();
+    char *command = transaction->command;
+    for (size_t i = 0; i < count; i++) {
+        OxInstIPSWaiter *waiter = pending[i];
+        bool field = (waiter->condition == OxInstIPSWaitFieldTarget);
+        asynStatus status = asynSuccess;
+        bool cancelled;
+        lock();
+        cancelled = waiter->cancelled;
+        unlock();
+        if (cancelled) continue;
+        if (waiter->rate > 0.0) {
+            epicsSnprintf(command, sizeof(transaction->command), field ? "T%#.*f" : "S%#.*f",
+                          setDecimals(field ? &OxInstIPSModelInfo::fieldRateDecimals
+                                            : &OxInstIPSModelInfo::currentRateDecimals), waiter->rate);
+            status = sendCommand(command);
+        }
+        epicsSnprintf(command, sizeof(transaction->command), field ? "J%#.*f" : "I%#.*f",
+                      setDecimals(field ? &OxInstIPSModelInfo::fieldDecimals : &OxInstIPSModelInfo::currentDecimals),
+                      waiter->target);
+        if (status == asynSuccess) status = sendCommand(command);
+        if (status == asynSuccess) status = sendCommand("A1");
+        lock();
+        waiter->failed = (status != asynSuccess);
+        waiter->started = true;
+        if (waiter->cancelled) holdPending_ = true;
+        unlock();
+    }
+    transactions_.release(transaction);
+}
+
+/* Run the sequence from where it stopped until it reaches a wait it cannot pass or ends.
+ * Runs on the poll thread at the start of each cycle; status is the X status read last
+ * cycle, after anything sent before it, so a wait begun in this call is first checked on
+ * the next.  A sequence that fails or is aborted holds the sweep. */
+void OxInstIPSDriver::runSequence(const Status &status, bool statusValid)
+{
+    static const char *functionName = "runSequence";
+    const OxInstIPSStep *steps;
+    size_t step;
+    bool waiting, abort;
+    double heaterTime, moveTimeout, target, rate, value;
+    int state = OxInstIPSSequenceRunning;
+    asynStatus result = asynSuccess;
+    epicsTimeStamp now;
+
+    lock();
+    steps = seqSteps_;
+    step = seqStep_;
+    waiting = seqWaiting_;
+    abort = seqAbort_;
+    getDoubleParam(P_SeqHeaterTime, &heaterTime);
+    getDoubleParam(P_MoveTimeout, &moveTimeout);
+    getDoubleParam(P_SeqTarget, &target);
+    getDoubleParam(P_SeqRate, &rate);
+    unlock();
+    if (steps == NULL) return;
+
+    OxInstIPSTransaction *transaction = transactions_.allocate();
+    char *command = transaction->command;
+    epicsTimeGetCurrent(&now);
+    if (abort) state = OxInstIPSSequenceAborted;
+    while (state == OxInstIPSSequenceRunning) {
+        const OxInstIPSStep &current = steps[step];
+        double elapsed = waiting ? epicsTimeDiffInSeconds(&now, &seqSince_) : 0.0;
+        bool heaterOn = statusValid && status.heater == OXINSTIPS_HEATER_ON;
+        bool heaterOff = statusValid && (status.heater == OXINSTIPS_HEATER_OFF_AT_ZERO ||
+                                         status.heater == OXINSTIPS_HEATER_OFF_AT_FIELD);
+        bool advance = true;
+
+        switch (current.op) {
+        case OxInstIPSStepSend:
+            result = sendCommand(current.command);
+            break;
+        case OxInstIPSStepSendRate:
+            lock();
+            if (rate > 0.0) result = checkSetpoint('T', rate);
+            unlock();
+            if (rate > 0.0 && result == asynSuccess) {
+                epicsSnprintf(command, sizeof(transaction->command), "T%#.*f",
+                              setDecimals(&OxInstIPSModelInfo::fieldRateDecimals), rate);
+                result = sendCommand(command);
+            }
+            break;
+        case OxInstIPSStepSendTarget:
+            lock();
+            result = checkSetpoint('J', target);
+            unlock();
+            if (result != asynSuccess) break;
+            epicsSnprintf(command, sizeof(transaction->command), "J%#.*f",
+                          setDecimals(&OxInstIPSModelInfo::fieldDecimals), target);
+            result = sendCommand(command);
+            break;
+        case OxInstIPSStepMatchPersistent:
+            if (!hasRead(18)) {
+                result = asynError;
+                break;
+            }
+            result = readParameter(18, transaction);
+            if (result == asynSuccess &&
+                (transaction->reply[0] != 'R' || !OxInstIPSParseNumber(transaction->reply + 1, &value))) {
+                result = asynError;
+            }
+            if (result == asynSuccess) {
+                epicsSnprintf(command, sizeof(transaction->command), "J%#.*f",
+                              setDecimals(&OxInstIPSModelInfo::fieldDecimals), value);
+                result = sendCommand(command);
+            }
+            break;
+        case OxInstIPSStepWaitAtRest:
+            if (!waiting) advance = false;
+            else if (statusValid && status.sweepStatus == OXINSTIPS_SWEEP_AT_REST) advance = true;
+            else if (moveTimeout > 0.0 && elapsed > moveTimeout) result = asynTimeout;
+            else advance = false;
+            break;
+        case OxInstIPSStepWaitHeaterOn:
+        case OxInstIPSStepWaitHeaterOff:
+            if (statusValid && (status.heater == OXINSTIPS_HEATER_FAULT ||
+                                status.heater == OXINSTIPS_HEATER_NO_SWITCH)) result = asynError;
+            else if (!waiting) advance = false;
+            else if ((current.op == OxInstIPSStepWaitHeaterOn ? heaterOn : heaterOff) &&
+                     elapsed >= heaterTime) advance = true;
+            else if (moveTimeout > 0.0 && elapsed > heaterTime + moveTimeout) result = asynTimeout;
+            else advance = false;
+            break;
+        case OxInstIPSStepEnd:
+            state = OxInstIPSSequenceDone;
+            advance = false;
+            break;
+        }
+        if (result != asynSuccess) {
+            state = OxInstIPSSequenceFailed;
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: %s: %s failed at step %lu, status=%d\n", driverName, functionName,
+                portName, OxInstIPSSequenceName(seqId_), (unsigned long)step, result);
+        } else if (!advance) {
+            if (!waiting) seqSince_ = now;
+            waiting = true;
+            break;
+        } else {
+            step++;
+            waiting = false;
+        }
+    }
+    if (state == OxInstIPSSequenceFailed || state == OxInstIPSSequenceAborted) sendCommand("A0");
+    transactions_.release(transaction);
+
+    lock();
+    seqStep_ = step;
+    seqWaiting_ = waiting;
+    if (state != OxInstIPSSequenceRunning) {
+        seqSteps_ = NULL;
+        seqAbort_ = false;
+    }
+    setIntegerParam(P_SeqState, state);
+    setIntegerParam(P_SeqStep, (int)step);
+    callParamCallbacks();
+    unlock();
+}
+
+/* Called with the driver locked after every poll cycle. */
+void OxInstIPSDriver::updateFilter(bool valid, const Status &status)
+{
+    double demandCurrent, measuredCurrent;
+
+    if (!valid) {
+        filter_.reset();
+        setParamStatus(P_FiltCurrent, asynError);
+        setParamStatus(P_FiltVariance, asynError);
+        return;
+    }
+    getDoubleParam(P_DemandCurrent, &demandCurrent);
+    getDoubleParam(P_MeasuredCurrent, &measuredCurrent);
+    filter_.update(demandCurrent, measuredCurrent, status.sweepStatus != OXINSTIPS_SWEEP_AT_REST);
+    setDoubleParam(P_FiltCurrent, filter_.current());
+    setDoubleParam(P_FiltVariance, filter_.variance());
+    setParamStatus(P_FiltCurrent, asynSuccess);
+    setParamStatus(P_FiltVariance, asynSuccess);
+}
+
+/* Called with the driver locked after every poll cycle, once the read parameters are set.
+ * A unit whose firmware has hung may go on answering with frozen values, so a parameter
+ * that stops changing when it should is marked stale: its status is set to an error
+ * and it is counted in STALE.  Returns the number of stale parameters. */
+int OxInstIPSDriver::updateStale(const epicsTimeStamp *readTimes, const asynStatus *readStatus,
+                                 const double *values, const Status &status)
+{
+    static const char *functionName = "updateStale";
+    double timeout;
+    int count = 0;
+
+    /* R is read before X, so a parameter is only expected to move on readings taken after
+     * the poll that first saw the sweep. */
+    bool sweeping = status.sweepStatus != OXINSTIPS_SWEEP_AT_REST &&
+                    (status.activity == OXINSTIPS_ACTIVITY_TO_SET_POINT ||
+                     status.activity == OXINSTIPS_ACTIVITY_TO_ZERO);
+    if (sweeping && !sweeping_) epicsTimeGetCurrent(&sweepingSince_);
+    sweeping_ = sweeping;
+
+    /* The last value and change of each parameter live in the unit table, for the overview
+     * pass over all units.  Each column is locked only while this unit's slot is updated. */
+    OxInstIPSUnitTable &table = OxInstIPSUnitTable::instance();
+    getDoubleParam(P_StaleTimeout, &timeout);
+    for (size_t i = 0; i < NumReadParams && i < OXINSTIPS_UNIT_PARAMS; i++) {
+        const ReadParam &param = readParams_[i];
+        bool stale = false, wasStale;
+
+        table.lockColumn(i);
+        double &value = table.value(i, unit_), &changed = table.changed(i, unit_);
+        wasStale = table.stale(i, unit_) != 0.0;
+        table.valid(i, unit_) = (readStatus[i] == asynSuccess) ? 1.0 : 0.0;
+        if (readStatus[i] == asynSuccess && (table.seen(i, unit_) == 0.0 || values[i] != value)) {
+            table.seen(i, unit_) = 1.0;
+            value = values[i];
+            changed = OxInstIPSUnitTable::toSeconds(readTimes[i]);
+        } else if (readStatus[i] == asynSuccess) {
+            double age = OxInstIPSUnitTable::toSeconds(readTimes[i]) - changed;
+            if (param.rate && sweeping) {
+                double sweepAge = epicsTimeDiffInSeconds(&readTimes[i], &sweepingSince_);
+                double rate, target = 0.0, tolerance;
+                getDoubleParam(this->*param.rate, &rate);
+                if (status.activity == OXINSTIPS_ACTIVITY_TO_SET_POINT) getDoubleParam(this->*param.target, &target);
+                getDoubleParam(this->*param.tolerance, &tolerance);
+                double expected = std::min(fabs(rate) * std::min(age, sweepAge) / 60.0, fabs(target - values[i]));
+                if (sweepAge > 0.0 && expected > tolerance) stale = true;
+            }
+            if (param.noisy && timeout > 0.0 && age > timeout) stale = true;
+        }
+        table.stale(i, unit_) = stale ? 1.0 : 0.0;
+        table.unlockColumn(i);
+
+        if (stale && !wasStale) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: %s: %s stuck at %g\n", driverName, functionName, portName, param.name, values[i]);
+        }
+        if (stale) {
+            setParamStatus(this->*param.index, asynError);
+            count++;
+        }
+    }
+    setIntegerParam(P_Stale, count);
+    return count;
+}
+
+/* Called with the driver locked after every poll cycle.  readTimes, readStatus, values and
+ * polled are indexed as readParams_.  A failed or skipped read leaves the statistics as
+ * they were. */
+void OxInstIPSDriver::updateStats(const epicsTimeStamp *readTimes, const asynStatus *readStatus,
+                                  const double *values, const bool *polled)
+{
+    for (size_t i = 0; i < NumReadParams; i++) {
+        OxInstIPSStats &stats = stats_[i];
+        if (polled[i] && readStatus[i] == asynSuccess) stats.addSample(readTimes[i], values[i]);
+        if (stats.count() > 0) {
+            setDoubleParam(P_StatsMin[i], stats.min());
+            setDoubleParam(P_StatsMax[i], stats.max());
+            setDoubleParam(P_StatsMean[i], stats.mean());
+            setDoubleParam(P_StatsStddev[i], stats.stddev());
+        }
+        asynStatus status = stats.count() > 0 ? asynSuccess : asynError;
+        setParamStatus(P_StatsMin[i], status);
+        setParamStatus(P_StatsMax[i], status);
+        setParamStatus(P_StatsMean[i], status);
+        setParamStatus(P_StatsStddev[i], status);
+    }
+}
+
+/* Called with the driver locked after every poll cycle.  readTimes and readStatus are
+ * indexed as readParams_. */
+void OxInstIPSDriver::updateEstimate(const epicsTimeStamp *readTimes, const asynStatus *readStatus,
+                                     asynStatus statusStatus, const Status &status)
+{
+    double current, field, currentRate, fieldRate, currentTarget, fieldTarget;
+    int currentIndex = -1, fieldIndex = -1;
+    bool sweeping;
+
+    /* Only the inputs of the estimate count: the demands, the sweep rates and the X
+     * status, and the setpoints while sweeping to them.  readStatus holds the last read
+     * of each parameter, including those not due this cycle. */
+    bool toSetPoint = (status.activity == OXINSTIPS_ACTIVITY_TO_SET_POINT);
+    bool ok = (statusStatus == asynSuccess);
+    for (size_t i = 0; i < NumReadParams && ok; i++) {
+        int OxInstIPSDriver::*index = readParams_[i].index;
+        bool input = index == &OxInstIPSDriver::P_DemandCurrent || index == &OxInstIPSDriver::P_DemandField ||
+                     index == &OxInstIPSDriver::P_CurrentSweepRate || index == &OxInstIPSDriver::P_FieldSweepRate ||
+                     (toSetPoint && (index == &OxInstIPSDriver::P_SetpointCurrent ||
+                                     index == &OxInstIPSDriver::P_SetpointField));
+        if (input && readStatus[i] != asynSuccess) ok = false;
+        if (index == &OxInstIPSDriver::P_DemandCurrent) currentIndex = (int)i;
+        if (index == &OxInstIPSDriver::P_DemandField) fieldIndex = (int)i;
+    }
+    if (!ok) {
+        estimator_.invalidate();
+        return;
+    }
+    getDoubleParam(P_DemandCurrent, &current);
+    getDoubleParam(P_DemandField, &field);
+    getDoubleParam(P_CurrentSweepRate, &currentRate);
+    getDoubleParam(P_FieldSweepRate, &fieldRate);
+    if (status.activity == OXINSTIPS_ACTIVITY_TO_ZERO) {
+        currentTarget = 0.0;
+        fieldTarget = 0.0;
+    } else {
+        getDoubleParam(P_SetpointCurrent, &currentTarget);
+        getDoubleParam(P_SetpointField, &fieldTarget);
+    }
+    sweeping = status.sweepStatus != OXINSTIPS_SWEEP_AT_REST &&
+               (status.activity == OXINSTIPS_ACTIVITY_TO_SET_POINT ||
+                status.activity == OXINSTIPS_ACTIVITY_TO_ZERO);
+    estimator_.update(readTimes[currentIndex], current, readTimes[fieldIndex], field,
+                      currentRate, fieldRate, currentTarget, fieldTarget, sweeping);
+}
+
+/* Called with the driver locked. */
+void OxInstIPSDriver::publishEstimate()
+{
+    epicsTimeStamp now;
+    double current, field;
+    bool estimated;
+
+    epicsTimeGetCurrent(&now);
+    if (estimator_.estimate(now, &current, &field, &estimated)) {
+        setDoubleParam(P_EstDemandCurrent, current);
+        setDoubleParam(P_EstDemandField, field);
+        setIntegerParam(P_Estimated, estimated ? 1 : 0);
+        setParamStatus(P_EstDemandCurrent, asynSuccess);
+        setParamStatus(P_EstDemandField, asynSuccess);
+    } else {
+        setParamStatus(P_EstDemandCurrent, asynError);
+        setParamStatus(P_EstDemandField, asynError);
+    }
+}
+
+/* Called with the driver locked. */
+void OxInstIPSDriver::fillHistorySample(OxInstIPSHistorySample *sample, const epicsTimeStamp &time,
+                                        const asynStatus *readStatus, asynStatus statusStatus,
+                                        const Status &status)
+{
+    /* History values are in the same order as readParams_. */
+    sample->time = OxInstIPSHistory::toNanoseconds(time);
+    for (size_t i = 0; i < NumReadParams && i < OXINSTIPS_HISTORY_VALUES; i++) {
+        double value = NAN;
+        if (readStatus[i] == asynSuccess) getDoubleParam(this->*readParams_[i].index, &value);
+        sample->values[i] = value;
+    }
+    sample->status[0] = (epicsUInt8)status.fault;
+    sample->status[1] = (epicsUInt8)status.limit;
+    sample->status[2] = (epicsUInt8)status.activity;
+    sample->status[3] = (epicsUInt8)status.control;
+    sample->status[4] = (epicsUInt8)status.heater;
+    sample->status[5] = (epicsUInt8)status.sweepMode;
+    sample->status[6] = (epicsUInt8)status.sweepStatus;
+    sample->statusValid = (statusStatus == asynSuccess);
+}
+
+asynStatus OxInstIPSDriver::openHistory(const char *fileName, size_t maxPoints)
+{
+    if (!history_.open(fileName)) return asynError;
+    lock();
+    historyMaxPoints_ = maxPoints;
+    setIntegerParam(P_HistSamples, (int)history_.count());
+    callParamCallbacks();
+    unlock();
+    return asynSuccess;
+}
+
+/* Called with the driver locked from writeInt32.  The lock is released during the
+ * search so the poll thread is not held up by a long query.  Raw queries return each
+ * sample as its own min and max; aggregate levels ignore HIST_DECIMATION. */
+asynStatus OxInstIPSDriver::queryHistory()
+{
+    std::vector<int> channels(1);
+    std::vector<double> times;
+    std::vector<std::vector<double> > mins, maxs, values;
+    epicsTimeStamp now, start, end, began, finished;
+    double startSeconds, endSeconds;
+    int decimation, resolution, level;
+
+    if (!history_.isOpen()) return asynError;
+    getIntegerParam(P_HistChannel, &channels[0]);
+    getIntegerParam(P_HistDecimation, &decimation);
+    getIntegerParam(P_HistResolution, &resolution);
+    getDoubleParam(P_HistStart, &startSeconds);
+    getDoubleParam(P_HistEnd, &endSeconds);
+
+    epicsTimeGetCurrent(&now);
+    start = OxInstIPSHistory::fromRequestSeconds(startSeconds, now);
+    end = OxInstIPSHistory::fromRequestSeconds(endSeconds, now);
+
+    unlock();
+    epicsTimeGetCurrent(&began);
+    if (resolution == 1) level = history_.chooseLevel(start, end, historyMaxPoints_);
+    else level = (resolution >= 2) ? resolution - 2 : OXINSTIPS_HISTORY_RAW;
+    if (level == OXINSTIPS_HISTORY_RAW) {
+        history_.query(channels, start, end, decimation > 0 ? decimation : 1, historyMaxPoints_,
+                       &times, &values);
+        mins = values;
+        maxs = values;
+    } else {
+        history_.queryLevel(channels, level, start, end, historyMaxPoints_, &times, &mins, &maxs, &values);
+    }
+    epicsTimeGetCurrent(&finished);
+    lock();
+
+    setIntegerParam(P_HistPoints, (int)times.size());
+    setDoubleParam(P_HistQueryTime, epicsTimeDiffInSeconds(&finished, &began) * 1000.0);
+    setDoubleParam(P_HistBucket, OxInstIPSHistory::levelSeconds(level));
+    doCallbacksFloat64Array(times.empty() ? NULL : &times[0], times.size(), P_HistTimes, 0);
+    doCallbacksFloat64Array(values[0].empty() ? NULL : &values[0][0], values[0].size(), P_HistValues, 0);
+    doCallbacksFloat64Array(mins[0].empty() ? NULL : &mins[0][0], mins[0].size(), P_HistMin, 0);
+    doCallbacksFloat64Array(maxs[0].empty() ? NULL : &maxs[0][0], maxs[0].size(), P_HistMax, 0);
+    return asynSuccess;
+}
+
+/* Publishes the estimates between polls at ESTIMATE_PERIOD.  The poll thread
+ * publishes them as well whenever a real reading arrives. */
+void OxInstIPSDriver::estimateTask()
+{
+    double period;
+
+    for (;;) {
+        lock();
+        getDoubleParam(P_EstimatePeriod, &period);
+        if (period > 0.0) {
+            publishEstimate();
+            callParamCallbacks();
+        }
+        unlock();
+        if (period > 0.0) epicsEventWaitWithTimeout(estimateEvent_, period);
+        else epicsEventWait(estimateEvent_);
+    }
+}
+
+/* Called with the driver locked at the start of a poll cycle.  Fills order with the read
+ * parameters due by now, earliest deadline first, and returns how many there are.  all
+ * makes every parameter due, as when a write wakes the poll thread for fresh readings. */
+size_t OxInstIPSDriver::scheduleReads(const epicsTimeStamp &now, bool all, size_t *order)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < NumReadParams; i++) {
+        if (!isSupported(i)) continue;
+        if (!all && epicsTimeDiffInSeconds(&schedule_[i].due, &now) > OXINSTIPS_SCHEDULE_SLACK) continue;
+        OXINSTIPS_TRACE2(enqueue, portName, readParams_[i].name);
+        /* Insertion sort on the deadline - there are only a few parameters, and ties keep
+         * the table order.  While shedding, higher priorities go first. */
+        size_t j = count++;
+        while (j > 0) {
+            const ReadParam &param = readParams_[i], &prev = readParams_[order[j - 1]];
+            if (shedFrom_ < NumPriorities && param.priority != prev.priority) {
+                if (param.priority > prev.priority) break;
+            } else if (!epicsTimeLessThan(&schedule_[i].due, &schedule_[order[j - 1]].due)) {
+                break;
+            }
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    return count;
+}
+
+bool OxInstIPSDriver::isShed(size_t param) const
+{
+    return readParams_[param].priority >= shedFrom_;
+}
+
+/* Called with the driver locked at the end of a poll cycle.  Publishes the achieved period
+ * and lateness of each parameter read, moves its deadline on by its period, and returns
+ * when the next cycle is due: the earliest deadline, or one poll period on for the status.
+ * A read more than a period late has missed its deadline.
+ *
+ * A cycle that leaves reads for the next one, or misses a deadline, is overloaded and
+ * sheds the lowest priority still polled at its own period; parameters shed are polled
+ * OXINSTIPS_SHED_FACTOR times less often.  Priorities come back one at a time after
+ * OXINSTIPS_SHED_RECOVER_CYCLES cycles without overload.  Critical parameters are never
+ * shed. */
+epicsTimeStamp OxInstIPSDriver::advanceSchedule(const epicsTimeStamp &cycleTime, const epicsTimeStamp &endTime,
+                                                const epicsTimeStamp *readTimes, const bool *polled,
+                                                size_t deferred)
+{
+    static const char *functionName = "advanceSchedule";
+    epicsTimeStamp next;
+    bool overloaded = deferred > 0;
+
+    if (epicsTimeLessThan(&cycleTime, &cycleDue_)) cycleDue_ = cycleTime;
+    epicsTimeAddSeconds(&cycleDue_, pollPeriod_);
+    if (epicsTimeLessThan(&cycleDue_, &endTime)) cycleDue_ = endTime;
+    next = cycleDue_;
+
+    for (size_t i = 0; i < NumReadParams; i++) {
+        Schedule &sched = schedule_[i];
+        if (!isSupported(i)) continue;
+        if (polled[i]) {
+            double period, late;
+            getDoubleParam(P_PollPeriod[i], &period);
+            if (period <= 0.0) period = pollPeriod_;
+            if (isShed(i)) period *= OXINSTIPS_SHED_FACTOR;
+            late = epicsTimeDiffInSeconds(&readTimes[i], &sched.due);
+            if (late > period) {
+                pollMisses_++;
+                overloaded = true;
+                asynPrint(pasynUserSelf, ASYN_TRACE_WARNING,
+                    "%s:%s: %s: %s read %.3f s late\n",
+                    driverName, functionName, portName, readParams_[i].name, late);
+            }
+            if (sched.read) setDoubleParam(P_PollActual[i], epicsTimeDiffInSeconds(&readTimes[i], &sched.lastRead));
+            setDoubleParam(P_PollLate[i], std::max(0.0, late) * 1000.0);
+            sched.read = true;
+            sched.lastRead = readTimes[i];
+            /* Early reads restart the period; late ones keep the phase unless a whole
+             * period has been lost. */
+            if (late < 0.0) sched.due = readTimes[i];
+            epicsTimeAddSeconds(&sched.due, period);
+            if (epicsTimeLessThan(&sched.due, &readTimes[i])) sched.due = readTimes[i];
+        }
+        if (epicsTimeLessThan(&sched.due, &next)) next = sched.due;
+    }
+
+    if (overloaded) {
+        calmCycles_ = 0;
+        if (shedFrom_ > PriorityCritical + 1) {
+            shedFrom_--;
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: %s: overloaded, %lu read(s) deferred, polling %s less often\n",
+                driverName, functionName, portName, (unsigned long)deferred,
+                shedFrom_ == PriorityConfig ? "setpoints and rates" : "all but critical readbacks");
+        }
+    } else if (shedFrom_ < NumPriorities && ++calmCycles_ >= OXINSTIPS_SHED_RECOVER_CYCLES) {
+        calmCycles_ = 0;
+        shedFrom_++;
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: %s: load eased, %s\n", driverName, functionName, portName,
+            shedFrom_ < NumPriorities ? "restoring one priority" : "all parameters at their own period");
+    }
+    setIntegerParam(P_PollMisses, (int)pollMisses_);
+    setIntegerParam(P_PollDeferred, (int)deferred);
+    setIntegerParam(P_PollShed, NumPriorities - shedFrom_);
+    return next;
+}
+
+/* Called with the driver locked at the end of every poll cycle.  wakeTime is when the
+ * cycle started and lateness how long after its scheduled time. */
+void OxInstIPSDriver::publishPollTiming(const epicsTimeStamp &wakeTime, const epicsTimeStamp &endTime,
+                                        double lateness)
+{
+    static const char *functionName = "publishPollTiming";
+    double deadline;
+
+    pollCycles_++;
+    pollCycleEnd_ = endTime;
+    pollLatency_ = epicsTimeDiffInSeconds(&endTime, &wakeTime);
+    getDoubleParam(P_PollDeadline, &deadline);
+    if (deadline > 0.0 && pollLatency_ > deadline) {
+        pollOverruns_++;
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: %s: poll cycle took %.3f s, deadline %.3f s\n",
+            driverName, functionName, portName, pollLatency_, deadline);
+    }
+    if (pollStalled_) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: %s: poll loop running again\n", driverName, functionName, portName);
+        pollStalled_ = false;
+    }
+    setIntegerParam(P_PollCycles, (int)pollCycles_);
+    setDoubleParam(P_PollLatency, pollLatency_ * 1000.0);
+    setDoubleParam(P_PollJitter, lateness * 1000.0);
+    setIntegerParam(P_PollOverruns, (int)pollOverruns_);
+    setIntegerParam(P_PollAlive, 1);
+}
+
+/* The poll loop cannot report that it is stuck, so this thread checks that a cycle has
+ * ended within the poll period plus the deadline and clears POLL_ALIVE if not. */
+void OxInstIPSDriver::watchdogTask()
+{
+    static const char *functionName = "watchdogTask";
+    epicsTimeStamp now;
+    double deadline, idle;
+
+    for (;;) {
+        epicsThreadSleep(OXINSTIPS_WATCHDOG_PERIOD);
+        lock();
+        getDoubleParam(P_PollDeadline, &deadline);
+        epicsTimeGetCurrent(&now);
+        idle = epicsTimeDiffInSeconds(&now, &pollCycleEnd_);
+        if (deadline > 0.0 && !pollStalled_ && idle > pollPeriod_ + deadline) {
+            pollStalled_ = true;
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: %s: no poll cycle for %.1f s\n", driverName, functionName, portName, idle);
+            setIntegerParam(P_PollAlive, 0);
+            callParamCallbacks();
+        }
+        unlock();
+    }
+}
+
+void OxInstIPSDriver::pollTask()
+{
+    OxInstIPSTransaction *reads[NumReadParams];
+    double values[NumReadParams];
+    asynStatus valueStatus[NumReadParams];
+    epicsTimeStamp readTimes[NumReadParams];
+    bool polled[NumReadParams];
+    size_t order[NumReadParams];
+    size_t due, read;
+    Status status = Status();
+    asynStatus statusStatus = asynDisconnected;
+    bool valid;
+    OxInstIPSHistorySample historySample;
+    epicsTimeStamp cycleTime, wakeTime, endTime, nextDue, now;
+    double lateness = 0.0, wait;
+    bool woken = true, hold;
+    size_t heapBefore;
+
+    epicsTimeGetCurrent(&now);
+    for (size_t i = 0; i < NumReadParams; i++) {
+        values[i] = 0.0;
+        valueStatus[i] = asynDisconnected;
+        readTimes[i] = now;
+    }
+
+    for (;;) {
+        epicsTimeGetCurrent(&wakeTime);
+        heapBefore = heapAllocations();
+        if (!capsKnown_ && !epicsTimeLessThan(&wakeTime, &detectDue_)) detectCapabilities();
+        if (!epicsTimeLessThan(&wakeTime, &limitsDue_)) readLimits();
+        startMoves();
+        lock();
+        hold = holdPending_;
+        holdPending_ = false;
+        unlock();
+        if (hold) sendCommand("A0");
+        runSequence(status, statusStatus == asynSuccess);
+        restoreConfig();
+
+        /* The serial port does its own locking, so the driver is not held across the I/O.
+         * The read parameters that are due are read earliest deadline first; if that takes
+         * longer than the poll period the rest wait for the next cycle, at the front of the
+         * queue, so that the status is still read every cycle. */
+        epicsTimeGetCurrent(&cycleTime);
+        lock();
+        due = scheduleReads(cycleTime, woken, order);
+        unlock();
+        for (size_t i = 0; i < NumReadParams; i++) polled[i] = false;
+        for (read = 0; read < due; read++) {
+            size_t i = order[read];
+            if (read > 0 && epicsTimeDiffInSeconds(&readTimes[order[read - 1]], &cycleTime) > pollPeriod_) break;
+            reads[i] = transactions_.allocate();
+            valueStatus[i] = readParameter(readParams_[i].command, reads[i]);
+            epicsTimeGetCurrent(&readTimes[i]);
+            polled[i] = true;
+        }
+        parseParameters(reads, polled, valueStatus, values);
+        for (size_t i = 0; i < NumReadParams; i++) {
+            if (polled[i]) transactions_.release(reads[i]);
+        }
+        valid = true;
+        for (size_t i = 0; i < NumReadParams; i++) {
+            if (isSupported(i) && valueStatus[i] != asynSuccess) valid = false;
+        }
+        statusStatus = readStatus(&status);
+        if (statusStatus != asynSuccess) valid = false;
+
+        lock();
+        for (size_t i = 0; i < NumReadParams; i++) {
+            int index = this->*readParams_[i].index;
+            if (!polled[i]) continue;
+            if (valueStatus[i] == asynSuccess) setDoubleParam(index, values[i]);
+            setParamStatus(index, valueStatus[i]);
+        }
+        publishStatus(statusStatus, status);
+        if (updateStale(readTimes, valueStatus, values, status) > 0) valid = false;
+        updateFieldConstant();
+        updateSettle(valid, status);
+        updateFilter(valid, status);
+        updateStats(readTimes, valueStatus, values, polled);
+        updateEstimate(readTimes, valueStatus, statusStatus, status);
+        publishEstimate();
+        completeWaiters(status);
+        fillHistorySample(&historySample, cycleTime, valueStatus, statusStatus, status);
+        OXINSTIPS_TRACE2(publish, portName, pollCycles_ + 1);
+        callParamCallbacks();
+        unlock();
+
+        if (history_.isOpen()) history_.append(historySample);
+
+        epicsTimeGetCurrent(&endTime);
+        lock();
+        if (history_.isOpen()) setIntegerParam(P_HistSamples, (int)history_.count());
+        nextDue = advanceSchedule(cycleTime, endTime, readTimes, polled, due - read);
+        publishPollTiming(wakeTime, endTime, lateness);
+        if (heapAllocations() != heapBefore) allocatingCycles_++;
+        callParamCallbacks();
+        unlock();
+
+        /* A signalled poll starts early, which is not jitter. */
+        epicsTimeGetCurrent(&now);
+        wait = epicsTimeDiffInSeconds(&nextDue, &now);
+        if (wait > 0.0) woken = epicsEventWaitWithTimeout(pollEvent_, wait) == epicsEventWaitOK;
+        else woken = epicsEventTryWait(pollEvent_) == epicsEventWaitOK;
+        if (woken) {
+            lateness = 0.0;
+        } else {
+            epicsTimeGetCurrent(&now);
+            lateness = std::max(0.0, epicsTimeDiffInSeconds(&now, &nextDue));
+        }
+    }
+}
+
+asynStatus OxInstIPSDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+
+    if (function == P_SettleWindow) {
+        if (value < 1) value = 1;
+        settle_.setWindow((size_t)value);
+    } else if (function == P_HistQuery) {
+        status = queryHistory();
+    } else if (function == P_SeqStart) {
+        const OxInstIPSStep *steps = OxInstIPSSequenceSteps(value);
+        double target, rate;
+        getDoubleParam(P_SeqTarget, &target);
+        getDoubleParam(P_SeqRate, &rate);
+        if (steps == NULL || seqSteps_ != NULL) {
+            status = asynError;
+        } else if (value == OxInstIPSSequenceRamp &&
+                   (checkSetpoint('J', target) != asynSuccess ||
+                    (rate > 0.0 && checkSetpoint('T', rate) != asynSuccess))) {
+            status = asynError;
+        } else {
+            seqSteps_ = steps;
+            seqId_ = value;
+            seqStep_ = 0;
+            seqWaiting_ = false;
+            seqAbort_ = false;
+            setIntegerParam(P_SeqState, OxInstIPSSequenceRunning);
+            setIntegerParam(P_SeqStep, 0);
+            epicsEventSignal(pollEvent_);
+        }
+    } else if (function == P_ConfigSave) {
+        status = saveConfig();
+    } else if (function == P_ConfigRestore) {
+        status = requestRestore();
+    } else if (function == P_ConfigSweepMode) {
+        setConfigMask(configMask_ | (1u << NumConfigItems));
+    } else if (function == P_ConfigMask) {
+        setConfigMask((unsigned)value);
+        value = (epicsInt32)configMask_;
+    } else if (function == P_ConfigWait) {
+        if (value < 0) value = -1;
+    } else if (function == P_SeqAbort) {
+        if (seqSteps_ != NULL && value != 0) {
+            seqAbort_ = true;
+            epicsEventSignal(pollEvent_);
+        }
+    }
+    setIntegerParam(function, value);
+    callParamCallbacks();
+    return status;
+}
+
+asynStatus OxInstIPSDriver::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+    double currentTolerance, fieldTolerance;
+
+    setDoubleParam(function, value);
+    if (function == P_SettleCurrentTol || function == P_SettleFieldTol) {
+        getDoubleParam(P_SettleCurrentTol, &currentTolerance);
+        getDoubleParam(P_SettleFieldTol, &fieldTolerance);
+        settle_.setTolerances(currentTolerance, fieldTolerance);
+    } else if (function == P_EstimatePeriod) {
+        epicsEventSignal(estimateEvent_);
+    } else if (function == P_FiltMeasNoise || function == P_FiltRestNoise || function == P_FiltSweepNoise) {
+        double measurementNoise, restNoise, sweepNoise;
+        getDoubleParam(P_FiltMeasNoise, &measurementNoise);
+        getDoubleParam(P_FiltRestNoise, &restNoise);
+        getDoubleParam(P_FiltSweepNoise, &sweepNoise);
+        filter_.setNoise(measurementNoise, restNoise, sweepNoise);
+    } else if (function == P_StatsWindow) {
+        if (value < 0.0) value = 0.0;
+        setDoubleParam(function, value);
+        for (size_t i = 0; i < NumReadParams; i++) stats_[i].setWindow(value);
+    } else {
+        for (size_t i = 0; i < NumConfigItems; i++) {
+            if (function == this->*configItems_[i].saved) setConfigMask(configMask_ | (1u << i));
+        }
+        for (size_t i = 0; i < NumReadParams; i++) {
+            /* Takes effect from the next read of the parameter. */
+            if (function == P_PollPeriod[i] && value < 0.0) setDoubleParam(function, 0.0);
+        }
+    }
+    callParamCallbacks();
+    return status;
+}
+
+std::vector<OxInstIPSDriver *> OxInstIPSDriver::drivers()
+{
+    driversMutex.lock();
+    std::vector<OxInstIPSDriver *> list = driverList;
+    driversMutex.unlock();
+    return list;
+}
+
+void OxInstIPSDriver::getMetrics(OxInstIPSMetricsSample *sample)
+{
+    int deferred, stale, alive;
+
+    sample->port = portName;
+    sample->counters = counters_.values();
+    lock();
+    getIntegerParam(P_PollDeferred, &deferred);
+    getIntegerParam(P_Stale, &stale);
+    getIntegerParam(P_PollAlive, &alive);
+    sample->pollCycles = pollCycles_;
+    sample->pollOverruns = pollOverruns_;
+    sample->pollMisses = pollMisses_;
+    sample->deferred = deferred;
+    sample->waiters = (int)waiters_.size();
+    sample->shed = NumPriorities - shedFrom_;
+    sample->stale = stale;
+    sample->alive = alive;
+    unlock();
+}
+
+/* Heap allocations on the command path: transactions beyond the pool and growth of the
+ * waiter queue.  Neither happens in steady state. */
+size_t OxInstIPSDriver::heapAllocations() const
+{
+    return transactions_.counts().heapAllocations + waiterAllocations_;
+}
+
+void OxInstIPSDriver::report(FILE *fp, int details)
+{
+    OxInstIPSPoolCounts pool = transactions_.counts();
+
+    fprintf(fp, "OxInstIPS driver %s: poll period %g s, command gap %g s, %d waiter(s)\n",
+            portName, pollPeriod_, commandGap_, (int)waiters_.size());
+    fprintf(fp, "  %lu poll cycles, last %.1f ms, %lu overrun(s)%s\n",
+            (unsigned long)pollCycles_, pollLatency_ * 1000.0, (unsigned long)pollOverruns_,
+            pollStalled_ ? ", stalled" : "");
+    fprintf(fp, "  model %s x%d", model_.name, model_.units);
+    if (model_.maxCurrent > 0.0) fprintf(fp, ", %g A", model_.maxCurrent);
+    fprintf(fp, ", profile %s%s\n", caps_->name, capsKnown_ ? "" : " (V not read yet)");
+    if (seqSteps_ != NULL) {
+        fprintf(fp, "  sequence %s at step %lu%s\n", OxInstIPSSequenceName(seqId_),
+                (unsigned long)seqStep_, seqWaiting_ ? ", waiting" : "");
+    }
+    fprintf(fp, "  command path: %lu transaction(s) from a pool of %lu, peak %lu in use, "
+            "%lu heap allocation(s), %lu poll cycle(s) allocating\n",
+            (unsigned long)pool.allocations, (unsigned long)transactions_.capacity(),
+            (unsigned long)pool.peak, (unsigned long)heapAllocations(), (unsigned long)allocatingCycles_);
+    if (history_.isOpen()) {
+        size_t count = history_.count(), bytes = history_.bytes();
+        fprintf(fp, "  history %s: %lu samples, %lu bytes (%.1f bytes/sample)\n",
+                history_.fileName().c_str(), (unsigned long)count, (unsigned long)bytes,
+                count ? (double)bytes / count : 0.0);
+    }
+    asynPortDriver::report(fp, details);
+}
+
+/* Configuration routine.  Called directly, or from the iocsh function below. */
+extern "C" {
+
+int OxInstIPSConfig(const char *portName, const char *serialPort, int pollPeriodMs, int commandGapMs)
+{
+    if (pollPeriodMs <= 0) pollPeriodMs = 500;
+    if (commandGapMs < 0) commandGapMs = 0;
+    new OxInstIPSDriver(portName, serialPort, pollPeriodMs / 1000.0, commandGapMs / 1000.0, OxInstIPSGenericModel());
+    return asynSuccess;
+}
+
+int OxInstIPSModelConfig(const char *portName, const char *serialPort, const char *model,
+                         int pollPeriodMs, int commandGapMs)
+{
+    const OxInstIPSModelInfo *info = OxInstIPSFindModel(model);
+
+    if (pollPeriodMs <= 0) pollPeriodMs = 500;
+    if (commandGapMs < 0) commandGapMs = 0;
+    if (info == NULL) {
+        printf("OxInstIPSModelConfig: unknown model %s; models are", model ? model : "(none)");
+        for (size_t i = 0; OxInstIPSModelName(i); i++) printf(" %s", OxInstIPSModelName(i));
+        printf("\n");
+        return asynError;
+    }
+    new OxInstIPSDriver(portName, serialPort, pollPeriodMs / 1000.0, commandGapMs / 1000.0, *info);
+    return asynSuccess;
+}
+
+static const iocshArg modelArg0 = { "portName", iocshArgString };
+static const iocshArg modelArg1 = { "serialPort", iocshArgString };
+static const iocshArg modelArg2 = { "model", iocshArgString };
+static const iocshArg modelArg3 = { "pollPeriodMs", iocshArgInt };
+static const iocshArg modelArg4 = { "commandGapMs", iocshArgInt };
+static const iocshArg * const modelArgs[] = { &modelArg0, &modelArg1, &modelArg2, &modelArg3, &modelArg4 };
+static const iocshFuncDef modelFuncDef = { "OxInstIPSModelConfig", 5, modelArgs };
+
+static void modelCallFunc(const iocshArgBuf *args)
+{
+    OxInstIPSModelConfig(args[0].sval, args[1].sval, args[2].sval, args[3].ival, args[4].ival);
+}
+
+static const iocshArg initArg0 = { "portName", iocshArgString };
+static const iocshArg initArg1 = { "serialPort", iocshArgString };
+static const iocshArg initArg2 = { "pollPeriodMs", iocshArgInt };
+static const iocshArg initArg3 = { "commandGapMs", iocshArgInt };
+static const iocshArg * const initArgs[] = { &initArg0, &initArg1, &initArg2, &initArg3 };
+static const iocshFuncDef initFuncDef = { "OxInstIPSConfig", 4, initArgs };
+
+static void initCallFunc(const iocshArgBuf *args)
+{
+    OxInstIPSConfig(args[0].sval, args[1].sval, args[2].ival, args[3].ival);
+}
+
+int OxInstIPSHistoryConfig(const char *portName, const char *fileName, int maxPoints)
+{
+    asynPortDriver *pDriver = static_cast<asynPortDriver *>(findAsynPortDriver(portName));
+    OxInstIPSDriver *pIPS = dynamic_cast<OxInstIPSDriver *>(pDriver);
+
+    if (pIPS == NULL) {
+        printf("OxInstIPSHistoryConfig: %s is not an OxInstIPS port\n", portName);
+        return asynError;
+    }
+    if (maxPoints <= 0) maxPoints = 10000;
+    return pIPS->openHistory(fileName, (size_t)maxPoints);
+}
+
+static const iocshArg historyArg0 = { "portName", iocshArgString };
+static const iocshArg historyArg1 = { "fileName", iocshArgString };
+static const iocshArg historyArg2 = { "maxPoints", iocshArgInt };
+static const iocshArg * const historyArgs[] = { &historyArg0, &historyArg1, &historyArg2 };
+static const iocshFuncDef historyFuncDef = { "OxInstIPSHistoryConfig", 3, historyArgs };
+
+static void historyCallFunc(const iocshArgBuf *args)
+{
+    OxInstIPSHistoryConfig(args[0].sval, args[1].sval, args[2].ival);
+}
+
+void OxInstIPSDriverRegister(void)
+{
+    iocshRegister(&initFuncDef, initCallFunc);
+    iocshRegister(&modelFuncDef, modelCallFunc);
+    iocshRegister(&historyFuncDef, historyCallFunc);
+}
+
+epicsExportRegistrar(OxInstIPSDriverRegister);
+
+}
@@ -0,0 +1,519 @@
+/* OxInstIPSDriver.h
+ *
+ * asyn port driver for the Oxford Instruments IPS superconducting magnet power supply.
+ *
+ * The driver polls the read parameters (R command) and the status (X command) over
+ * an asyn octet port, the same port the StreamDevice protocol would use, and
+ * publishes them as asyn parameters together with values derived from them.
+ *
+ * Configure from the IOC shell with
+ *   OxInstIPSConfig(portName, serialPort, pollPeriodMs, commandGapMs)
+ */
+#ifndef OxInstIPSDriver_H
+#define OxInstIPSDriver_H
+
+#include <vector>
+
+#include "asynPortDriver.h"
+#include "callback.h"
+#include "dbCommon.h"
+#include "epicsEvent.h"
+#include "epicsTime.h"
+
+#include "OxInstIPSCapability.h"
+#include "OxInstIPSEstimator.h"
+#include "OxInstIPSHistory.h"
+#include "OxInstIPSKalman.h"
+#include "OxInstIPSMetrics.h"
+#include "OxInstIPSModel.h"
+#include "OxInstIPSPool.h"
+#include "OxInstIPSSequence.h"
+#include "OxInstIPSSettle.h"
+#include "OxInstIPSStats.h"
+#include "OxInstIPSUnitTable.h"
+
+/* Read parameters - R command */
+#define P_DemandCurrentString       "DEMAND_CURRENT"        /* asynFloat64 R0, A */
+#define P_SupplyVoltageString       "SUPPLY_VOLTAGE"        /* asynFloat64 R1, V */
+#define P_MeasuredCurrentString     "MEASURED_CURRENT"      /* asynFloat64 R2, A */
+#define P_SetpointCurrentString     "SETPOINT_CURRENT"      /* asynFloat64 R5, A */
+#define P_CurrentSweepRateString    "CURRENT_SWEEP_RATE"    /* asynFloat64 R6, A/min */
+#define P_DemandFieldString         "DEMAND_FIELD"          /* asynFloat64 R7, T */
+#define P_SetpointFieldString       "SETPOINT_FIELD"        /* asynFloat64 R8, T */
+#define P_FieldSweepRateString      "FIELD_SWEEP_RATE"      /* asynFloat64 R9, T/min */
+
+/* Status - X command */
+#define P_SystemFaultString         "SYSTEM_FAULT"          /* asynInt32 X m */
+#define P_SystemLimitString         "SYSTEM_LIMIT"          /* asynInt32 X n */
+#define P_ActivityString            "ACTIVITY"              /* asynInt32 A n */
+#define P_ControlString             "CONTROL"               /* asynInt32 C n */
+#define P_HeaterString              "HEATER"                /* asynInt32 H n */
+#define P_SweepModeString           "SWEEP_MODE"            /* asynInt32 M m */
+#define P_SweepStatusString         "SWEEP_STATUS"          /* asynInt32 M n */
+
+/* Settle detection */
+#define P_SettledString             "SETTLED"               /* asynInt32 r/o */
+#define P_SettleWindowString        "SETTLE_WINDOW"         /* asynInt32 r/w, samples */
+#define P_SettleCurrentTolString    "SETTLE_CURRENT_TOL"    /* asynFloat64 r/w, A */
+#define P_SettleFieldTolString      "SETTLE_FIELD_TOL"      /* asynFloat64 r/w, T */
+#define P_SettleTimeoutString       "SETTLE_TIMEOUT"        /* asynFloat64 r/w, s */
+#define P_SettleCurrentNoiseString  "SETTLE_CURRENT_NOISE"  /* asynFloat64 r/o, A */
+#define P_SettleFieldNoiseString    "SETTLE_FIELD_NOISE"    /* asynFloat64 r/o, T */
+
+/* Setpoint moves with put-callback completion */
+#define P_MoveTimeoutString         "MOVE_TIMEOUT"          /* asynFloat64 r/w, s */
+#define P_MovesActiveString         "MOVES_ACTIVE"          /* asynInt32 r/o */
+
+/* Inter-poll estimates of R0 and R7 */
+#define P_EstimatePeriodString      "ESTIMATE_PERIOD"       /* asynFloat64 r/w, s, 0 = off */
+#define P_EstDemandCurrentString    "EST_DEMAND_CURRENT"    /* asynFloat64 r/o, A */
+#define P_EstDemandFieldString      "EST_DEMAND_FIELD"      /* asynFloat64 r/o, T */
+#define P_EstimatedString           "ESTIMATED"             /* asynInt32 r/o */
+
+/* Kalman-filtered magnet current */
+#define P_FiltCurrentString         "FILT_CURRENT"          /* asynFloat64 r/o, A */
+#define P_FiltVarianceString        "FILT_VARIANCE"         /* asynFloat64 r/o, A^2 */
+#define P_FiltMeasNoiseString       "FILT_MEAS_NOISE"       /* asynFloat64 r/w, A */
+#define P_FiltRestNoiseString       "FILT_REST_NOISE"       /* asynFloat64 r/w, A per sample */
+#define P_FiltSweepNoiseString      "FILT_SWEEP_NOISE"      /* asynFloat64 r/w, A per sample */
+
+/* Readback history */
+#define P_HistSamplesString         "HIST_SAMPLES"          /* asynInt32 r/o */
+#define P_HistChannelString         "HIST_CHANNEL"          /* asynInt32 r/w, OxInstIPSHistory channel */
+#define P_HistStartString           "HIST_START"            /* asynFloat64 r/w, POSIX s, <= 0 relative to now */
+#define P_HistEndString             "HIST_END"              /* asynFloat64 r/w, POSIX s, <= 0 relative to now */
+#define P_HistDecimationString      "HIST_DECIMATION"       /* asynInt32 r/w */
+#define P_HistQueryString           "HIST_QUERY"            /* asynInt32 w/o */
+#define P_HistPointsString          "HIST_POINTS"           /* asynInt32 r/o */
+#define P_HistQueryTimeString       "HIST_QUERY_TIME"       /* asynFloat64 r/o, ms */
+#define P_HistTimesString           "HIST_TIMES"            /* asynFloat64Array r/o, POSIX s */
+#define P_HistValuesString          "HIST_VALUES"           /* asynFloat64Array r/o, sample or bucket mean */
+#define P_HistResolutionString      "HIST_RESOLUTION"       /* asynInt32 r/w, 0 raw, 1 auto, 2+n level n */
+#define P_HistBucketString          "HIST_BUCKET"           /* asynFloat64 r/o, s, 0 for raw samples */
+#define P_HistMinString             "HIST_MIN"              /* asynFloat64Array r/o */
+#define P_HistMaxString             "HIST_MAX"              /* asynFloat64Array r/o */
+
+/* Rolling statistics of each read parameter, named <read parameter>_MIN etc. */
+#define P_StatsWindowString         "STATS_WINDOW"          /* asynFloat64 r/w, s */
+#define OXINSTIPS_STATS_MIN_SUFFIX      "_MIN"              /* asynFloat64 r/o */
+#define OXINSTIPS_STATS_MAX_SUFFIX      "_MAX"              /* asynFloat64 r/o */
+#define OXINSTIPS_STATS_MEAN_SUFFIX     "_MEAN"             /* asynFloat64 r/o */
+#define OXINSTIPS_STATS_STDDEV_SUFFIX   "_STDDEV"           /* asynFloat64 r/o */
+
+/* Stuck-value detection */
+#define P_StaleString               "STALE"                 /* asynInt32 r/o, number of stale read parameters */
+#define P_StaleTimeoutString        "STALE_TIMEOUT"         /* asynFloat64 r/w, s, 0 = off */
+
+/* Poll loop watchdog */
+#define P_PollCyclesString          "POLL_CYCLES"           /* asynInt32 r/o, heartbeat */
+#define P_PollLatencyString         "POLL_LATENCY"          /* asynFloat64 r/o, ms */
+#define P_PollJitterString          "POLL_JITTER"           /* asynFloat64 r/o, ms */
+#define P_PollDeadlineString        "POLL_DEADLINE"         /* asynFloat64 r/w, s, 0 = off */
+#define P_PollOverrunsString        "POLL_OVERRUNS"         /* asynInt32 r/o */
+#define P_PollAliveString           "POLL_ALIVE"            /* asynInt32 r/o */
+#define P_PollMissesString          "POLL_MISSES"           /* asynInt32 r/o */
+#define P_PollDeferredString        "POLL_DEFERRED"         /* asynInt32 r/o, reads left for the next cycle */
+#define P_PollShedString            "POLL_SHED"             /* asynInt32 r/o, 0 none, 1 config, 2 also diagnostics */
+
+/* Model and firmware, from the V reply */
+#define P_ModelString               "MODEL"                 /* asynOctet r/o */
+#define P_VersionString             "VERSION"               /* asynOctet r/o, rest of the V reply */
+#define P_FirmwareString            "FIRMWARE"              /* asynFloat64 r/o, 0 if unknown */
+#define P_ProfileString             "PROFILE"               /* asynOctet r/o, capability profile */
+
+/* Setpoint limits, read from the IPS and checked before setpoints are sent */
+#define P_LimitNegCurrentString     "LIMIT_NEG_CURRENT"     /* asynFloat64 r/o, A, R21 */
+#define P_LimitPosCurrentString     "LIMIT_POS_CURRENT"     /* asynFloat64 r/o, A, R22 */
+#define P_TripCurrentString         "TRIP_CURRENT"          /* asynFloat64 r/o, A, R17 */
+#define P_TripFieldString           "TRIP_FIELD"            /* asynFloat64 r/o, T, R19 */
+#define P_FieldConstantString       "FIELD_CONSTANT"        /* asynFloat64 r/o, T/A, 0 until known */
+#define P_SetpointRejectsString     "SETPOINT_REJECTS"      /* asynInt32 r/o */
+
+/* Configuration set, saved from the readbacks and restored in one burst */
+#define P_ConfigSaveString          "CONFIG_SAVE"           /* asynInt32 w/o */
+#define P_ConfigRestoreString       "CONFIG_RESTORE"        /* asynInt32 w/o */
+#define P_ConfigStateString         "CONFIG_STATE"          /* asynInt32 r/o, OxInstIPSConfigState */
+#define P_ConfigMismatchesString    "CONFIG_MISMATCHES"     /* asynInt32 r/o, items not read back as restored */
+#define P_ConfigSweepModeString     "CONFIG_SWEEP_MODE"     /* asynInt32 r/w, M */
+#define P_ConfigCurrentRateString   "CONFIG_CURRENT_RATE"   /* asynFloat64 r/w, A/min, S */
+#define P_ConfigFieldRateString     "CONFIG_FIELD_RATE"     /* asynFloat64 r/w, T/min, T */
+#define P_ConfigSetCurrentString    "CONFIG_SET_CURRENT"    /* asynFloat64 r/w, A, I */
+#define P_ConfigSetFieldString      "CONFIG_SET_FIELD"      /* asynFloat64 r/w, T, J */
+#define P_ConfigWaitString          "CONFIG_WAIT"           /* asynInt32 r/w, ms, W, -1 = leave as is */
+#define P_ConfigMaskString          "CONFIG_MASK"           /* asynInt32 r/w, items that hold a value */
+
+/* Multi-step sequences */
+#define P_SeqStartString            "SEQ_START"             /* asynInt32 w/o, OxInstIPSSequenceId */
+#define P_SeqAbortString            "SEQ_ABORT"             /* asynInt32 w/o */
+#define P_SeqStateString            "SEQ_STATE"             /* asynInt32 r/o, OxInstIPSSequenceState */
+#define P_SeqStepString             "SEQ_STEP"              /* asynInt32 r/o, step running or waiting */
+#define P_SeqHeaterTimeString       "SEQ_HEATER_TIME"       /* asynFloat64 r/w, s */
+#define P_SeqTargetString           "SEQ_TARGET"            /* asynFloat64 r/w, T */
+#define P_SeqRateString             "SEQ_RATE"              /* asynFloat64 r/w, T/min, 0 = leave as is */
+
+/* Per read parameter poll schedule, named <read parameter>_POLL_PERIOD etc. */
+#define OXINSTIPS_POLL_PERIOD_SUFFIX    "_POLL_PERIOD"      /* asynFloat64 r/w, s, 0 = poll period */
+#define OXINSTIPS_POLL_ACTUAL_SUFFIX    "_POLL_ACTUAL"      /* asynFloat64 r/o, s */
+#define OXINSTIPS_POLL_LATE_SUFFIX      "_POLL_LATE"        /* asynFloat64 r/o, ms */
+
+/* Sweep status "At rest" in the M n digit of the X reply. */
+#define OXINSTIPS_SWEEP_AT_REST 0
+
+/* Activity "To Set Point" in the A n digit of the X reply. */
+#define OXINSTIPS_ACTIVITY_HOLD 0
+#define OXINSTIPS_ACTIVITY_TO_SET_POINT 1
+#define OXINSTIPS_ACTIVITY_TO_ZERO 2
+
+/* Replies are short - the longest is the X status string. */
+#define OXINSTIPS_REPLY_SIZE 64
+#define OXINSTIPS_COMMAND_SIZE 32
+
+/* The buffers of one command and its reply, taken from the port's pool. */
+struct OxInstIPSTransaction {
+    char command[OXINSTIPS_COMMAND_SIZE];
+    char reply[OXINSTIPS_REPLY_SIZE];
+};
+
+/* Transactions in the pool of a port: the reads of a poll cycle, the status and a move. */
+#define OXINSTIPS_TRANSACTIONS 16
+
+/* Waiters queued before the queue has to grow; there is one per wait record. */
+#define OXINSTIPS_WAITERS 32
+
+class OxInstIPSDriver;
+
+enum OxInstIPSConfigState {
+    OxInstIPSConfigEmpty,           /* nothing saved */
+    OxInstIPSConfigSaved,
+    OxInstIPSConfigRestoring,       /* queued for the poll thread */
+    OxInstIPSConfigRestored,        /* sent and read back */
+    OxInstIPSConfigFailed           /* refused, not sent or not read back as sent */
+};
+
+enum OxInstIPSWaitCondition {
+    OxInstIPSWaitSettle,            /* field settled */
+    OxInstIPSWaitFieldTarget,       /* J sent, demand field (R7) at target */
+    OxInstIPSWaitCurrentTarget      /* I sent, demand current (R0) at target */
+};
+
+/* A record processed asynchronously until a driver condition is met.
+ * Owned by the device support, queued on the driver while the record is active. */
+struct OxInstIPSWaiter {
+    CALLBACK callback;
+    dbCommon *precord;
+    OxInstIPSDriver *driver;
+    OxInstIPSWaitCondition condition;
+    bool settle;                    /* target waits: also wait for the field to settle */
+    double target;
+    double rate;                    /* target waits: sweep rate to send first, 0 to leave as is */
+    void (*complete)(OxInstIPSWaiter *waiter);  /* called instead of processing precord */
+    void *userPvt;
+    bool started;                   /* target waits: setpoint and activity sent */
+    bool reached;
+    epicsTimeStamp deadline;
+    bool hasDeadline;
+    size_t samplesSeen;
+    bool timedOut;
+    bool failed;
+    bool cancelled;                 /* target waits: withdrawn by cancelSetpointWaiter() */
+};
+
+class OxInstIPSDriver : public asynPortDriver {
+public:
+    OxInstIPSDriver(const char *portName, const char *serialPort, double pollPeriod, double commandGap,
+                    const OxInstIPSModelInfo &model);
+
+    virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
+    virtual void report(FILE *fp, int details);
+
+    /* Queue a waiter that completes once the field has settled on samples taken after this call. */
+    asynStatus addSettleWaiter(OxInstIPSWaiter *waiter);
+
+    /* Queue a waiter that sends the setpoint and "To Set Point" from the poll thread,
+     * then completes once the demand reaches target (and settles, if waiter->settle). */
+    asynStatus addSetpointWaiter(OxInstIPSWaiter *waiter, double target);
+
+    /* Whether addSetpointWaiter() would accept the target and waiter->rate, without queuing. */
+    asynStatus checkSetpointWaiter(const OxInstIPSWaiter *waiter, double target);
+
+    /* Withdraw a queued setpoint waiter.  If its move has been sent the sweep is held;
+     * the waiter then completes as failed on the next poll. */
+    void cancelSetpointWaiter(OxInstIPSWaiter *waiter);
+
+    bool isWaiterQueued(OxInstIPSWaiter *waiter);
+    asynStatus getDemandField(double *field);
+
+    /* Keep the readback history in a memory-mapped file; queries return up to maxPoints. */
+    asynStatus openHistory(const char *fileName, size_t maxPoints);
+    /* The history is locked internally and may be queried from any thread. */
+    OxInstIPSHistory &history() { return history_; }
+
+    /* Every driver created, for exporters that cover all units. */
+    static std::vector<OxInstIPSDriver *> drivers();
+    void getMetrics(OxInstIPSMetricsSample *sample);
+
+    void pollTask();
+    void estimateTask();
+    void watchdogTask();
+
+protected:
+    int P_DemandCurrent;
+    int P_SupplyVoltage;
+    int P_MeasuredCurrent;
+    int P_SetpointCurrent;
+    int P_CurrentSweepRate;
+    int P_DemandField;
+    int P_SetpointField;
+    int P_FieldSweepRate;
+    int P_SystemFault;
+    int P_SystemLimit;
+    int P_Activity;
+    int P_Control;
+    int P_Heater;
+    int P_SweepMode;
+    int P_SweepStatus;
+    int P_Settled;
+    int P_SettleWindow;
+    int P_SettleCurrentTol;
+    int P_SettleFieldTol;
+    int P_SettleTimeout;
+    int P_SettleCurrentNoise;
+    int P_SettleFieldNoise;
+    int P_MoveTimeout;
+    int P_MovesActive;
+    int P_EstimatePeriod;
+    int P_EstDemandCurrent;
+    int P_EstDemandField;
+    int P_Estimated;
+    int P_FiltCurrent;
+    int P_FiltVariance;
+    int P_FiltMeasNoise;
+    int P_FiltRestNoise;
+    int P_FiltSweepNoise;
+    int P_HistSamples;
+    int P_HistChannel;
+    int P_HistStart;
+    int P_HistEnd;
+    int P_HistDecimation;
+    int P_HistQuery;
+    int P_HistPoints;
+    int P_HistQueryTime;
+    int P_HistTimes;
+    int P_HistValues;
+    int P_HistResolution;
+    int P_HistBucket;
+    int P_HistMin;
+    int P_HistMax;
+    int P_StatsWindow;
+    int P_Stale;
+    int P_StaleTimeout;
+    int P_PollCycles;
+    int P_PollLatency;
+    int P_PollJitter;
+    int P_PollDeadline;
+    int P_PollOverruns;
+    int P_PollAlive;
+    int P_PollMisses;
+    int P_PollDeferred;
+    int P_PollShed;
+    int P_Model;
+    int P_Version;
+    int P_Firmware;
+    int P_Profile;
+    int P_LimitNegCurrent;
+    int P_LimitPosCurrent;
+    int P_TripCurrent;
+    int P_TripField;
+    int P_FieldConstant;
+    int P_SetpointRejects;
+    int P_ConfigSave;
+    int P_ConfigRestore;
+    int P_ConfigState;
+    int P_ConfigMismatches;
+    int P_ConfigSweepMode;
+    int P_ConfigCurrentRate;
+    int P_ConfigFieldRate;
+    int P_ConfigSetCurrent;
+    int P_ConfigSetField;
+    int P_ConfigWait;
+    int P_ConfigMask;
+    int P_SeqStart;
+    int P_SeqAbort;
+    int P_SeqState;
+    int P_SeqStep;
+    int P_SeqHeaterTime;
+    int P_SeqTarget;
+    int P_SeqRate;
+
+private:
+    struct Status {
+        int fault;
+        int limit;
+        int activity;
+        int control;
+        int heater;
+        int sweepMode;
+        int sweepStatus;
+    };
+
+    /* Under overload, parameters are polled less often from the lowest priority up. */
+    enum Priority {
+        PriorityCritical,           /* readbacks the magnet is run on, never shed */
+        PriorityDiagnostic,
+        PriorityConfig,             /* setpoints and rates, which only change when written */
+        NumPriorities
+    };
+
+    /* Read parameters polled every cycle, in the order they are polled.  For stuck-value
+     * detection, a parameter with a rate must move towards its target while sweeping, and
+     * a noisy one (an ADC reading) must change within STALE_TIMEOUT. */
+    struct ReadParam {
+        int command;
+        const char *name;
+        int OxInstIPSDriver::*index;
+        int OxInstIPSDriver::*rate;         /* sweep rate per minute, or NULL */
+        int OxInstIPSDriver::*target;
+        int OxInstIPSDriver::*tolerance;    /* smallest movement expected to show */
+        bool noisy;
+        Priority priority;
+    };
+
+    /* When a read parameter is next due, and when it was last read. */
+    struct Schedule {
+        epicsTimeStamp due;
+        epicsTimeStamp lastRead;
+        bool read;
+    };
+
+    enum { NumReadParams = 8 };
+    static const ReadParam readParams_[NumReadParams];
+
+    /* A value of the configuration set: its set command, readback and saved copy. */
+    struct ConfigItem {
+        char command;
+        int read;                           /* R command of the readback */
+        int OxInstIPSDriver::*readback;
+        int OxInstIPSDriver::*saved;
+        int OxInstIPSModelInfo::*decimals;
+    };
+
+    /* Rates before setpoints, so that a unit sweeping to its setpoint changes rate first.
+     * The sweep mode is bit NumConfigItems of configMask_. */
+    enum { NumConfigItems = 4 };
+    static const ConfigItem configItems_[NumConfigItems];
+
+    /* Rolling statistics parameters, indexed as readParams_. */
+    int P_StatsMin[NumReadParams];
+    int P_StatsMax[NumReadParams];
+    int P_StatsMean[NumReadParams];
+    int P_StatsStddev[NumReadParams];
+
+    /* Poll schedule parameters, indexed as readParams_. */
+    int P_PollPeriod[NumReadParams];
+    int P_PollActual[NumReadParams];
+    int P_PollLate[NumReadParams];
+
+    asynStatus transact(const char *command, char *reply, size_t replySize);
+    asynStatus sendCommand(const char *command);
+    asynStatus sendSuppressed(const char *command);
+    void detectCapabilities();
+    bool isSupported(size_t param) const;
+    bool hasRead(int command) const;
+    int setDecimals(int OxInstIPSModelInfo::*decimals) const;
+    void readLimits();
+    void updateFieldConstant();
+    bool currentAllowed(double current) const;
+    asynStatus checkSetpoint(char command, double value);
+    void setConfigMask(unsigned mask);
+    asynStatus saveConfig();
+    asynStatus requestRestore();
+    void restoreConfig();
+    asynStatus sendBurst(const char (*commands)[OXINSTIPS_COMMAND_SIZE], size_t count);
+    void queueWaiter(OxInstIPSWaiter *waiter, double timeout);
+    void startMoves();
+    void runSequence(const Status &status, bool statusValid);
+    asynStatus readParameter(int command, OxInstIPSTransaction *transaction);
+    void parseParameters(OxInstIPSTransaction *const *reads, const bool *polled,
+                         asynStatus *valueStatus, double *values);
+    asynStatus readStatus(Status *status);
+    void publishStatus(asynStatus result, const Status &status);
+    size_t scheduleReads(const epicsTimeStamp &now, bool all, size_t *order);
+    epicsTimeStamp advanceSchedule(const epicsTimeStamp &cycleTime, const epicsTimeStamp &endTime,
+                                   const epicsTimeStamp *readTimes, const bool *polled, size_t deferred);
+    bool isShed(size_t param) const;
+    void updateSettle(bool valid, const Status &status);
+    void updateEstimate(const epicsTimeStamp *readTimes, const asynStatus *readStatus, asynStatus statusStatus,
+                        const Status &status);
+    void publishEstimate();
+    void updateFilter(bool valid, const Status &status);
+    int updateStale(const epicsTimeStamp *readTimes, const asynStatus *readStatus, const double *values,
+                    const Status &status);
+    void updateStats(const epicsTimeStamp *readTimes, const asynStatus *readStatus, const double *values,
+                     const bool *polled);
+    void fillHistorySample(OxInstIPSHistorySample *sample, const epicsTimeStamp &time,
+                           const asynStatus *readStatus, asynStatus statusStatus, const Status &status);
+    asynStatus queryHistory();
+    void publishPollTiming(const epicsTimeStamp &wakeTime, const epicsTimeStamp &endTime, double lateness);
+    bool waiterDone(OxInstIPSWaiter *waiter, const Status &status, bool settled);
+    void completeWaiters(const Status &status);
+    size_t heapAllocations() const;
+
+    asynUser *pasynUserSerial_;
+    double pollPeriod_;
+    double commandGap_;
+    OxInstIPSModelInfo model_;
+    epicsEventId pollEvent_;
+    epicsEventId estimateEvent_;
+    OxInstIPSSettle settle_;
+    std::vector<OxInstIPSWaiter *> waiters_;
+    size_t waiterAllocations_;      /* times waiters_ grew past its reserve */
+    OxInstIPSPool<OxInstIPSTransaction, OXINSTIPS_TRANSACTIONS> transactions_;
+    OxInstIPSEstimator estimator_;
+    OxInstIPSKalman filter_;
+    OxInstIPSHistory history_;
+    size_t historyMaxPoints_;
+    OxInstIPSStats stats_[NumReadParams];
+    size_t unit_;                   /* slot in OxInstIPSUnitTable */
+    bool sweeping_;
+    epicsTimeStamp sweepingSince_;
+    epicsUInt32 pollCycles_;
+    epicsUInt32 pollOverruns_;
+    epicsTimeStamp pollCycleEnd_;
+    double pollLatency_;
+    bool pollStalled_;
+    epicsUInt32 allocatingCycles_;  /* poll cycles that used the heap on the command path */
+    Schedule schedule_[NumReadParams];
+    epicsTimeStamp cycleDue_;
+    epicsUInt32 pollMisses_;
+    int shedFrom_;                  /* Priority values from this one up are shed */
+    size_t calmCycles_;
+    const OxInstIPSCapabilities *caps_;
+    bool capsKnown_;
+    bool extendedResolution_;       /* the driver sent Q4 */
+    epicsTimeStamp detectDue_;      /* next attempt to read V while capsKnown_ is false */
+    struct Limits {
+        bool known;
+        double negCurrent;          /* R21 */
+        double posCurrent;          /* R22 */
+        double tripCurrent;         /* R17, 0 if no trip */
+        double tripField;           /* R19 */
+    };
+    Limits limits_;
+    epicsTimeStamp limitsDue_;
+    double fieldConstant_;          /* T/A, 0 until the demand has been away from zero */
+    epicsUInt32 setpointRejects_;
+    int commsWait_;                 /* last W sent by the driver, -1 if none */
+    unsigned configMask_;           /* items of the configuration set that hold a value */
+    bool configRestore_;            /* restore queued for the poll thread */
+    const OxInstIPSStep *seqSteps_; /* running sequence, NULL if none */
+    int seqId_;
+    size_t seqStep_;
+    bool seqWaiting_;               /* seqStep_ is a wait that has begun */
+    epicsTimeStamp seqSince_;       /* when it began */
+    bool seqAbort_;
+    bool holdPending_;              /* a started move was cancelled: send A0 */
+    OxInstIPSCounters counters_;
+};
+
+#endif /* OxInstIPSDriver_H */
@@ -0,0 +1,66 @@
+/* OxInstIPSEstimator.cpp
+ *
+ * Linear model of the demand current and field between polls.  See OxInstIPSEstimator.h.
+ */
+#include <math.h>
+
+#include "OxInstIPSEstimator.h"
+
+OxInstIPSEstimator::OxInstIPSEstimator()
+    : valid_(false), sweeping_(false), current_(0.0), field_(0.0),
+      currentRate_(0.0), fieldRate_(0.0), currentTarget_(0.0), fieldTarget_(0.0)
+{
+    currentTime_.secPastEpoch = 0;
+    currentTime_.nsec = 0;
+    fieldTime_ = currentTime_;
+}
+
+void OxInstIPSEstimator::update(const epicsTimeStamp &currentTime, double current,
+                                const epicsTimeStamp &fieldTime, double field,
+                                double currentRate, double fieldRate,
+                                double currentTarget, double fieldTarget, bool sweeping)
+{
+    valid_ = true;
+    sweeping_ = sweeping;
+    currentTime_ = currentTime;
+    fieldTime_ = fieldTime;
+    current_ = current;
+    field_ = field;
+    currentRate_ = fabs(currentRate);
+    fieldRate_ = fabs(fieldRate);
+    currentTarget_ = currentTarget;
+    fieldTarget_ = fieldTarget;
+}
+
+void OxInstIPSEstimator::invalidate()
+{
+    valid_ = false;
+}
+
+/* Move towards the target at the sweep rate, stopping on it. */
+double OxInstIPSEstimator::extrapolate(double value, double ratePerMinute, double target, double seconds)
+{
+    if (seconds <= 0.0) return value;
+    double step = ratePerMinute * seconds / 60.0;
+    double remaining = target - value;
+
+    if (fabs(remaining) <= step) return target;
+    return remaining > 0.0 ? value + step : value - step;
+}
+
+bool OxInstIPSEstimator::estimate(const epicsTimeStamp &time, double *current, double *field, bool *estimated) const
+{
+    if (!valid_) return false;
+    if (!sweeping_) {
+        *current = current_;
+        *field = field_;
+        *estimated = false;
+        return true;
+    }
+    *current = extrapolate(current_, currentRate_, currentTarget_,
+                           epicsTimeDiffInSeconds(&time, &currentTime_));
+    *field = extrapolate(field_, fieldRate_, fieldTarget_,
+                         epicsTimeDiffInSeconds(&time, &fieldTime_));
+    *estimated = (*current != current_) || (*field != field_);
+    return true;
+}
@@ -0,0 +1,45 @@
+/* OxInstIPSEstimator.h
+ *
+ * Model of the demand current (R0) and demand field (R7) between polls.  While the IPS
+ * is sweeping, the demand moves linearly towards its target at the sweep rate (R6, R9),
+ * so the value at any time can be extrapolated from the last reading.  Each new reading
+ * replaces the model state, so the estimate never drifts more than one poll period.
+ */
+#ifndef OxInstIPSEstimator_H
+#define OxInstIPSEstimator_H
+
+#include "epicsTime.h"
+
+class OxInstIPSEstimator {
+public:
+    OxInstIPSEstimator();
+
+    /* Latest poll, with the times R0 and R7 were read.  Rates are per minute, as read
+     * from the IPS.  sweeping is false when the sweep status is "At rest" or the activity
+     * is Hold or Clamped. */
+    void update(const epicsTimeStamp &currentTime, double current,
+                const epicsTimeStamp &fieldTime, double field,
+                double currentRate, double fieldRate,
+                double currentTarget, double fieldTarget, bool sweeping);
+    void invalidate();
+
+    /* Returns false when there is no reading to extrapolate from.  *estimated is set when
+     * the values differ from the last reading. */
+    bool estimate(const epicsTimeStamp &time, double *current, double *field, bool *estimated) const;
+
+private:
+    static double extrapolate(double value, double ratePerMinute, double target, double seconds);
+
+    bool valid_;
+    bool sweeping_;
+    epicsTimeStamp currentTime_;
+    epicsTimeStamp fieldTime_;
+    double current_;
+    double field_;
+    double currentRate_;
+    double fieldRate_;
+    double currentTarget_;
+    double fieldTarget_;
+};
+
+#endif /* OxInstIPSEstimator_H */
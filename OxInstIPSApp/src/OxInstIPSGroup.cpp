@@ -0,0 +1,173 @@
+/* OxInstIPSGroup.cpp
+ *
+ * Overview arrays across every IPS unit in the IOC.  See OxInstIPSGroup.h.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsEvent.h"
+#include "epicsThread.h"
+#include "iocsh.h"
+
+#include "OxInstIPSGroup.h"
+#include "OxInstIPSUnitTable.h"
+
+#include "epicsExport.h"
+
+static const char *driverName = "OxInstIPSGroup";
+
+/* Shortest update period, s. */
+#define OXINSTIPS_GROUP_MIN_PERIOD 0.1
+
+static void updateTaskC(void *drvPvt)
+{
+    OxInstIPSGroup *pPvt = (OxInstIPSGroup *)drvPvt;
+    pPvt->updateTask();
+}
+
+OxInstIPSGroup::OxInstIPSGroup(const char *portName, double period)
+    : asynPortDriver(portName, 1,
+                     asynInt32Mask | asynFloat64Mask | asynInt32ArrayMask | asynFloat64ArrayMask | asynDrvUserMask,
+                     asynInt32Mask | asynFloat64Mask | asynInt32ArrayMask | asynFloat64ArrayMask,
+                     0, 1, 0, 0),
+      wakeEvent_(epicsEventMustCreate(epicsEventEmpty)), updates_(0)
+{
+    static const char *functionName = "OxInstIPSGroup";
+
+    createParam(P_GroupUnitsString,         asynParamInt32,        &P_GroupUnits);
+    createParam(P_GroupPeriodString,        asynParamFloat64,      &P_GroupPeriod);
+    createParam(P_GroupDemandCurrentString, asynParamFloat64Array, &P_GroupDemandCurrent);
+    createParam(P_GroupDemandFieldString,   asynParamFloat64Array, &P_GroupDemandField);
+    createParam(P_GroupFaultString,         asynParamInt32Array,   &P_GroupFault);
+    createParam(P_GroupStaleString,         asynParamInt32Array,   &P_GroupStale);
+
+    setIntegerParam(P_GroupUnits, 0);
+    setDoubleParam(P_GroupPeriod, period < OXINSTIPS_GROUP_MIN_PERIOD ? OXINSTIPS_GROUP_MIN_PERIOD : period);
+
+    if (epicsThreadCreate("OxInstIPSGroup",
+                          epicsThreadPriorityLow,
+                          epicsThreadGetStackSize(epicsThreadStackSmall),
+                          (EPICSTHREADFUNC)updateTaskC, this) == NULL) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: epicsThreadCreate failure\n", driverName, functionName);
+    }
+}
+
+/* Stores value and returns whether it differs, bit for bit so that NaN equals NaN. */
+template <class T>
+static bool assign(T &to, T value)
+{
+    if (memcmp(&to, &value, sizeof(T)) == 0) return false;
+    to = value;
+    return true;
+}
+
+/* The unit table's overview pass runs down its columns, then one pass over the units
+ * compares the results with the published arrays.  Units configured after the group are
+ * picked up on the next update; only the arrays that changed are published. */
+void OxInstIPSGroup::update()
+{
+    OxInstIPSUnitTable &table = OxInstIPSUnitTable::instance();
+    bool currentChanged = false, fieldChanged = false, faultChanged = false, staleChanged = false;
+
+    lock();
+    table.lock();
+    size_t units = table.units();
+    if (units != fault_.size()) {
+        demandCurrent_.resize(units, 0.0);
+        demandField_.resize(units, 0.0);
+        fault_.resize(units, 0);
+        stale_.resize(units, 0);
+        currentChanged = fieldChanged = faultChanged = staleChanged = true;
+        setIntegerParam(P_GroupUnits, (int)units);
+    }
+    if (units > 0) {
+        overview_.resize(4 * units);
+        double *current = &overview_[0], *field = current + units, *faults = field + units;
+        double *stales = faults + units;
+
+        table.overview(units, current, field, faults, stales);
+        for (size_t u = 0; u < units; u++) {
+            currentChanged |= assign<epicsFloat64>(demandCurrent_[u], current[u]);
+            fieldChanged |= assign<epicsFloat64>(demandField_[u], field[u]);
+            faultChanged |= assign<epicsInt32>(fault_[u], (epicsInt32)faults[u]);
+            staleChanged |= assign<epicsInt32>(stale_[u], (epicsInt32)stales[u]);
+        }
+    }
+    table.unlock();
+
+    if (currentChanged) doCallbacksFloat64Array(units ? &demandCurrent_[0] : NULL, units, P_GroupDemandCurrent, 0);
+    if (fieldChanged) doCallbacksFloat64Array(units ? &demandField_[0] : NULL, units, P_GroupDemandField, 0);
+    if (faultChanged) doCallbacksInt32Array(units ? &fault_[0] : NULL, units, P_GroupFault, 0);
+    if (staleChanged) doCallbacksInt32Array(units ? &stale_[0] : NULL, units, P_GroupStale, 0);
+    if (currentChanged || fieldChanged || faultChanged || staleChanged) updates_++;
+    callParamCallbacks();
+    unlock();
+}
+
+void OxInstIPSGroup::updateTask()
+{
+    double period;
+
+    for (;;) {
+        update();
+        lock();
+        getDoubleParam(P_GroupPeriod, &period);
+        unlock();
+        epicsEventWaitWithTimeout(wakeEvent_, period);
+    }
+}
+
+asynStatus OxInstIPSGroup::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
+{
+    int function = pasynUser->reason;
+
+    if (function == P_GroupPeriod) {
+        if (value < OXINSTIPS_GROUP_MIN_PERIOD) value = OXINSTIPS_GROUP_MIN_PERIOD;
+        epicsEventSignal(wakeEvent_);
+    }
+    setDoubleParam(function, value);
+    callParamCallbacks();
+    return asynSuccess;
+}
+
+void OxInstIPSGroup::report(FILE *fp, int details)
+{
+    OxInstIPSUnitTable &table = OxInstIPSUnitTable::instance();
+
+    fprintf(fp, "OxInstIPS group %s: %lu updates, units", portName, (unsigned long)updates_);
+    table.lock();
+    for (size_t u = 0; u < table.units(); u++) fprintf(fp, " %lu:%s", (unsigned long)u, table.port(u).c_str());
+    table.unlock();
+    fprintf(fp, "\n");
+    asynPortDriver::report(fp, details);
+}
+
+/* Configuration routine.  Called directly, or from the iocsh function below. */
+extern "C" {
+
+int OxInstIPSGroupConfig(const char *portName, int periodMs)
+{
+    new OxInstIPSGroup(portName, (periodMs > 0 ? periodMs : 500) / 1000.0);
+    return asynSuccess;
+}
+
+static const iocshArg initArg0 = { "portName", iocshArgString };
+static const iocshArg initArg1 = { "periodMs", iocshArgInt };
+static const iocshArg * const initArgs[] = { &initArg0, &initArg1 };
+static const iocshFuncDef initFuncDef = { "OxInstIPSGroupConfig", 2, initArgs };
+
+static void initCallFunc(const iocshArgBuf *args)
+{
+    OxInstIPSGroupConfig(args[0].sval, args[1].ival);
+}
+
+void OxInstIPSGroupRegister(void)
+{
+    iocshRegister(&initFuncDef, initCallFunc);
+}
+
+epicsExportRegistrar(OxInstIPSGroupRegister);
+
+}
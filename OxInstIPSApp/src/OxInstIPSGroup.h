@@ -0,0 +1,55 @@
+/* OxInstIPSGroup.h
+ *
+ * Overview of every IPS unit in the IOC: one array per readback with an element per
+ * unit, in the order the units were configured, so that an overview display needs a
+ * monitor per quantity rather than one per unit.  The arrays are taken from the unit
+ * table once per period and published only when they change.
+ *
+ * Configure from the IOC shell, after the units, with
+ *   OxInstIPSGroupConfig(portName, periodMs)
+ */
+#ifndef OxInstIPSGroup_H
+#define OxInstIPSGroup_H
+
+#include <vector>
+
+#include "asynPortDriver.h"
+#include "epicsEvent.h"
+
+#define P_GroupUnitsString          "GROUP_UNITS"           /* asynInt32 r/o */
+#define P_GroupPeriodString         "GROUP_PERIOD"          /* asynFloat64 r/w, s */
+#define P_GroupDemandCurrentString  "GROUP_DEMAND_CURRENT"  /* asynFloat64Array r/o, A, R0, NaN if not valid */
+#define P_GroupDemandFieldString    "GROUP_DEMAND_FIELD"    /* asynFloat64Array r/o, T, R7, NaN if not valid */
+#define P_GroupFaultString          "GROUP_FAULT"           /* asynInt32Array r/o, X m, -1 if no status */
+#define P_GroupStaleString          "GROUP_STALE"           /* asynInt32Array r/o, stale readbacks */
+
+class OxInstIPSGroup : public asynPortDriver {
+public:
+    OxInstIPSGroup(const char *portName, double period);
+
+    virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
+    virtual void report(FILE *fp, int details);
+
+    void updateTask();
+
+protected:
+    int P_GroupUnits;
+    int P_GroupPeriod;
+    int P_GroupDemandCurrent;
+    int P_GroupDemandField;
+    int P_GroupFault;
+    int P_GroupStale;
+
+private:
+    void update();
+
+    epicsEventId wakeEvent_;
+    std::vector<epicsFloat64> demandCurrent_;
+    std::vector<epicsFloat64> demandField_;
+    std::vector<epicsInt32> fault_;
+    std::vector<epicsInt32> stale_;
+    std::vector<double> overview_;  /* the unit table's overview pass: current, field, fault, stale */
+    epicsUInt32 updates_;           /* cycles in which an array changed */
+};
+
+#endif /* OxInstIPSGroup_H */
@@ -0,0 +1,642 @@
+/* OxInstIPSHistory.cpp
+ *
+ * Memory-mapped readback history for one IPS unit.  See OxInstIPSHistory.h.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "epicsStdio.h"
+#include "errlog.h"
+
+#include "OxInstIPSHistory.h"
+
+#define OXINSTIPS_HISTORY_MAGIC "OXIPSTS2"
+#define OXINSTIPS_HISTORY_VERSION 2
+
+#define OXINSTIPS_HISTORY_LEVEL_MAGIC "OXIPSAG1"
+#define OXINSTIPS_HISTORY_LEVEL_VERSION 1
+
+#define OXINSTIPS_HISTORY_NO_STATUS 0xff
+
+struct OxInstIPSHistory::Header {
+    char magic[8];
+    epicsUInt32 version;
+    epicsUInt32 blockSamples;
+    epicsUInt64 lastBlock;      /* offset of the last block, 0 if none */
+    char reserved[40];
+};
+
+/* Followed by the encoded samples.  Blocks start on 8 byte boundaries so that fill can
+ * be updated with one store after each sample is written. */
+struct OxInstIPSHistory::Block {
+    epicsUInt64 firstTime;      /* encoder start time, ns since the EPICS epoch */
+    epicsUInt64 fill;           /* bytes << 32 | samples */
+};
+
+/* Followed by count OxInstIPSHistoryAggregate records in time order. */
+struct OxInstIPSHistory::LevelHeader {
+    char magic[8];
+    epicsUInt32 version;
+    epicsUInt32 recordSize;
+    epicsUInt64 width;          /* ns */
+    epicsUInt64 count;
+    char reserved[32];
+};
+
+static const double levelWidths[OXINSTIPS_HISTORY_LEVELS] = { 10.0, 60.0, 600.0, 3600.0 };
+
+static epicsUInt64 blockFill(size_t bytes, size_t count)
+{
+    return ((epicsUInt64)bytes << 32) | (epicsUInt64)count;
+}
+
+static const char *channelNames[OXINSTIPS_HISTORY_CHANNELS] = {
+    "R0", "R1", "R2", "R5", "R6", "R7", "R8", "R9",
+    "X_FAULT", "X_LIMIT", "ACTIVITY", "CONTROL", "HEATER", "SWEEP_MODE", "SWEEP_STATUS"
+};
+
+OxInstIPSHistory::OxInstIPSHistory()
+    : count_(0), lastTime_(0), blockOpen_(false), growFailed_(false)
+{
+    for (int l = 0; l < OXINSTIPS_HISTORY_LEVELS; l++) {
+        levels_[l].width = (epicsUInt64)(levelWidths[l] * 1e9);
+        levels_[l].count = 0;
+        levels_[l].open.count = 0;
+    }
+}
+
+OxInstIPSHistory::~OxInstIPSHistory()
+{
+    close();
+}
+
+double OxInstIPSHistory::levelSeconds(int level)
+{
+    if (level < 0 || level >= OXINSTIPS_HISTORY_LEVELS) return 0.0;
+    return levelWidths[level];
+}
+
+int OxInstIPSHistory::channelIndex(const char *name)
+{
+    for (int i = 0; i < OXINSTIPS_HISTORY_CHANNELS; i++) {
+        if (strcmp(name, channelNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char *OxInstIPSHistory::channelName(int channel)
+{
+    if (channel < 0 || channel >= OXINSTIPS_HISTORY_CHANNELS) return NULL;
+    return channelNames[channel];
+}
+
+epicsUInt64 OxInstIPSHistory::toNanoseconds(const epicsTimeStamp &time)
+{
+    return (epicsUInt64)time.secPastEpoch * 1000000000u + time.nsec;
+}
+
+double OxInstIPSHistory::toPosixSeconds(epicsUInt64 nanoseconds)
+{
+    return nanoseconds / 1e9 + POSIX_TIME_AT_EPICS_EPOCH;
+}
+
+epicsTimeStamp OxInstIPSHistory::fromPosixSeconds(double seconds)
+{
+    epicsTimeStamp time;
+    double sinceEpoch = seconds - POSIX_TIME_AT_EPICS_EPOCH;
+
+    if (sinceEpoch < 0.0) sinceEpoch = 0.0;
+    time.secPastEpoch = (epicsUInt32)sinceEpoch;
+    time.nsec = (epicsUInt32)((sinceEpoch - time.secPastEpoch) * 1e9);
+    return time;
+}
+
+epicsTimeStamp OxInstIPSHistory::fromRequestSeconds(double seconds, const epicsTimeStamp &now)
+{
+    epicsTimeStamp time = now;
+
+    if (seconds > 0.0) return fromPosixSeconds(seconds);
+    epicsTimeAddSeconds(&time, seconds);
+    return time;
+}
+
+OxInstIPSHistory::Header *OxInstIPSHistory::header() const
+{
+    return reinterpret_cast<Header *>(file_.base());
+}
+
+OxInstIPSHistory::Block *OxInstIPSHistory::block(size_t offset) const
+{
+    return reinterpret_cast<Block *>(file_.base() + offset);
+}
+
+/* Offset of the first byte after an entry's encoded samples. */
+size_t OxInstIPSHistory::blockEnd(const IndexEntry &entry) const
+{
+    return entry.offset + sizeof(Block) + entry.bytes;
+}
+
+OxInstIPSHistory::LevelHeader *OxInstIPSHistory::levelHeader(int level) const
+{
+    return reinterpret_cast<LevelHeader *>(levels_[level].file.base());
+}
+
+OxInstIPSHistoryAggregate *OxInstIPSHistory::aggregate(int level, size_t n) const
+{
+    return reinterpret_cast<OxInstIPSHistoryAggregate *>(levels_[level].file.base() + sizeof(LevelHeader)) + n;
+}
+
+bool OxInstIPSHistory::open(const char *fileName)
+{
+    size_t size;
+
+    close();
+    mutex_.lock();
+    if (!file_.open(fileName, OXINSTIPS_HISTORY_GROW_BYTES, &size)) {
+        errlogPrintf("OxInstIPSHistory: cannot open %s\n", fileName);
+        mutex_.unlock();
+        return false;
+    }
+    if (size < sizeof(Header)) {
+        memset(header(), 0, sizeof(Header));
+        memcpy(header()->magic, OXINSTIPS_HISTORY_MAGIC, sizeof(header()->magic));
+        header()->version = OXINSTIPS_HISTORY_VERSION;
+        header()->blockSamples = OXINSTIPS_HISTORY_BLOCK_SAMPLES;
+        header()->lastBlock = 0;
+    } else if (memcmp(header()->magic, OXINSTIPS_HISTORY_MAGIC, sizeof(header()->magic)) != 0 ||
+               header()->version != OXINSTIPS_HISTORY_VERSION ||
+               header()->lastBlock + sizeof(Block) > file_.size()) {
+        errlogPrintf("OxInstIPSHistory: %s is not a history file for this version\n", fileName);
+        file_.close();
+        mutex_.unlock();
+        return false;
+    }
+    fileName_ = fileName;
+
+    /* Rebuild the index by walking the block headers. */
+    index_.clear();
+    count_ = 0;
+    lastTime_ = 0;
+    blockOpen_ = false;
+    growFailed_ = false;
+    size_t lastBlock = (size_t)header()->lastBlock;
+    for (size_t offset = sizeof(Header); lastBlock != 0 && offset <= lastBlock; ) {
+        const Block *b = block(offset);
+        IndexEntry entry;
+        entry.time = b->firstTime;
+        entry.offset = offset;
+        entry.count = (size_t)(b->fill & 0xffffffffu);
+        entry.bytes = (size_t)(b->fill >> 32);
+        if (blockEnd(entry) > file_.size()) {
+            errlogPrintf("OxInstIPSHistory: %s is truncated at block %lu\n",
+                         fileName, (unsigned long)index_.size());
+            break;
+        }
+        index_.push_back(entry);
+        count_ += entry.count;
+        offset = (blockEnd(entry) + 7) & ~(size_t)7;
+    }
+
+    /* The last sample time keeps new samples in order. */
+    if (!index_.empty()) {
+        std::vector<OxInstIPSHistorySample> samples;
+        lastTime_ = index_.back().time;
+        if (decodeBlock(index_.size() - 1, &samples) > 0) lastTime_ = samples.back().time;
+    }
+
+    for (int l = 0; l < OXINSTIPS_HISTORY_LEVELS; l++) {
+        openLevel(l);
+    }
+    replayLevels();
+    mutex_.unlock();
+    return true;
+}
+
+/* Called with the mutex held.  A level file that is missing or unreadable is started
+ * again, as replayLevels() can rebuild it from the samples. */
+bool OxInstIPSHistory::openLevel(int level)
+{
+    Level &lev = levels_[level];
+    char suffix[8];
+    size_t size;
+
+    sprintf(suffix, ".L%d", level);
+    std::string levelName = fileName_ + suffix;
+    lev.count = 0;
+    lev.open.count = 0;
+    if (!lev.file.open(levelName.c_str(), OXINSTIPS_HISTORY_LEVEL_GROW_BYTES, &size)) {
+        errlogPrintf("OxInstIPSHistory: cannot open %s\n", levelName.c_str());
+        return false;
+    }
+    LevelHeader *h = levelHeader(level);
+    if (size >= sizeof(LevelHeader) &&
+        memcmp(h->magic, OXINSTIPS_HISTORY_LEVEL_MAGIC, sizeof(h->magic)) == 0 &&
+        h->version == OXINSTIPS_HISTORY_LEVEL_VERSION &&
+        h->recordSize == sizeof(OxInstIPSHistoryAggregate) && h->width == lev.width &&
+        sizeof(LevelHeader) + h->count * sizeof(OxInstIPSHistoryAggregate) <= lev.file.size()) {
+        lev.count = (size_t)h->count;
+        return true;
+    }
+    if (size >= sizeof(LevelHeader)) {
+        errlogPrintf("OxInstIPSHistory: rebuilding %s\n", levelName.c_str());
+    }
+    memset(h, 0, sizeof(LevelHeader));
+    memcpy(h->magic, OXINSTIPS_HISTORY_LEVEL_MAGIC, sizeof(h->magic));
+    h->version = OXINSTIPS_HISTORY_LEVEL_VERSION;
+    h->recordSize = sizeof(OxInstIPSHistoryAggregate);
+    h->width = lev.width;
+    h->count = 0;
+    return true;
+}
+
+/* Called with the mutex held.  Feeds each level the samples after its last closed bucket. */
+void OxInstIPSHistory::replayLevels()
+{
+    epicsUInt64 from[OXINSTIPS_HISTORY_LEVELS], earliest = ~(epicsUInt64)0;
+    std::vector<OxInstIPSHistorySample> samples;
+
+    for (int l = 0; l < OXINSTIPS_HISTORY_LEVELS; l++) {
+        const Level &lev = levels_[l];
+        from[l] = lev.count ? aggregate(l, lev.count - 1)->time + lev.width : 0;
+        if (lev.file.isOpen() && from[l] < earliest) earliest = from[l];
+    }
+    if (earliest == ~(epicsUInt64)0 || index_.empty()) return;
+
+    std::vector<IndexEntry>::const_iterator it =
+        std::lower_bound(index_.begin(), index_.end(), earliest + 1);
+    for (size_t b = (it == index_.begin()) ? 0 : (size_t)(it - index_.begin()) - 1; b < index_.size(); b++) {
+        decodeBlock(b, &samples);
+        for (size_t n = 0; n < samples.size(); n++) {
+            for (int l = 0; l < OXINSTIPS_HISTORY_LEVELS; l++) {
+                if (samples[n].time >= from[l]) addToLevel(l, samples[n]);
+            }
+        }
+    }
+}
+
+void OxInstIPSHistory::close()
+{
+    mutex_.lock();
+    file_.close();
+    for (int l = 0; l < OXINSTIPS_HISTORY_LEVELS; l++) {
+        levels_[l].file.close();
+        levels_[l].count = 0;
+        levels_[l].open.count = 0;
+    }
+    index_.clear();
+    count_ = 0;
+    blockOpen_ = false;
+    mutex_.unlock();
+}
+
+/* Called with the mutex held. */
+void OxInstIPSHistory::addToLevel(int level, const OxInstIPSHistorySample &sample)
+{
+    Level &lev = levels_[level];
+    Bucket &bucket = lev.open;
+    epicsUInt64 start = sample.time - sample.time % lev.width;
+
+    if (!lev.file.isOpen()) return;
+    if (bucket.count > 0 && start != bucket.time) closeBucket(level);
+    if (bucket.count == 0) {
+        bucket.time = start;
+        for (int i = 0; i < OXINSTIPS_HISTORY_VALUES; i++) {
+            bucket.min[i] = HUGE_VAL;
+            bucket.max[i] = -HUGE_VAL;
+            bucket.sum[i] = 0.0;
+            bucket.valid[i] = 0;
+        }
+        memset(bucket.statusMin, OXINSTIPS_HISTORY_NO_STATUS, sizeof(bucket.statusMin));
+        memset(bucket.statusMax, 0, sizeof(bucket.statusMax));
+    }
+    bucket.count++;
+    for (int i = 0; i < OXINSTIPS_HISTORY_VALUES; i++) {
+        double value = sample.values[i];
+        if (isnan(value)) continue;
+        if (value < bucket.min[i]) bucket.min[i] = value;
+        if (value > bucket.max[i]) bucket.max[i] = value;
+        bucket.sum[i] += value;
+        bucket.valid[i]++;
+    }
+    if (sample.statusValid) {
+        for (int i = 0; i < OXINSTIPS_HISTORY_STATUS; i++) {
+            if (bucket.statusMin[i] == OXINSTIPS_HISTORY_NO_STATUS || sample.status[i] < bucket.statusMin[i]) {
+                bucket.statusMin[i] = sample.status[i];
+            }
+            if (sample.status[i] > bucket.statusMax[i]) bucket.statusMax[i] = sample.status[i];
+        }
+    }
+}
+
+/* Called with the mutex held.  Writes the open bucket to the level file. */
+void OxInstIPSHistory::closeBucket(int level)
+{
+    Level &lev = levels_[level];
+    Bucket &bucket = lev.open;
+
+    if (!lev.file.reserve(sizeof(LevelHeader) + (lev.count + 1) * sizeof(OxInstIPSHistoryAggregate),
+                          OXINSTIPS_HISTORY_LEVEL_GROW_BYTES)) {
+        /* The bucket is lost but the level stays open; the next one tries again. */
+        errlogPrintf("OxInstIPSHistory: cannot grow level %d of %s\n", level, fileName_.c_str());
+        bucket.count = 0;
+        return;
+    }
+    OxInstIPSHistoryAggregate *a = aggregate(level, lev.count);
+    memset(a, 0, sizeof(*a));
+    a->time = bucket.time;
+    a->count = (epicsUInt32)bucket.count;
+    for (int i = 0; i < OXINSTIPS_HISTORY_VALUES; i++) {
+        bool valid = bucket.valid[i] > 0;
+        a->min[i] = valid ? (epicsFloat32)bucket.min[i] : (epicsFloat32)NAN;
+        a->max[i] = valid ? (epicsFloat32)bucket.max[i] : (epicsFloat32)NAN;
+        a->mean[i] = valid ? (epicsFloat32)(bucket.sum[i] / bucket.valid[i]) : (epicsFloat32)NAN;
+    }
+    memcpy(a->statusMin, bucket.statusMin, sizeof(a->statusMin));
+    for (int i = 0; i < OXINSTIPS_HISTORY_STATUS; i++) {
+        a->statusMax[i] = (bucket.statusMin[i] == OXINSTIPS_HISTORY_NO_STATUS)
+                        ? OXINSTIPS_HISTORY_NO_STATUS : bucket.statusMax[i];
+    }
+    levelHeader(level)->count = ++lev.count;
+    bucket.count = 0;
+}
+
+/* Called with the mutex held.  The file stays mapped and each append tries again, so
+ * recording resumes once there is space; the failure is logged once. */
+void OxInstIPSHistory::growFailed()
+{
+    if (!growFailed_) errlogPrintf("OxInstIPSHistory: cannot grow %s, dropping samples\n", fileName_.c_str());
+    growFailed_ = true;
+}
+
+bool OxInstIPSHistory::append(const OxInstIPSHistorySample &newSample)
+{
+    OxInstIPSHistorySample s = newSample;
+
+    mutex_.lock();
+    if (!file_.isOpen()) {
+        mutex_.unlock();
+        return false;
+    }
+    /* Keep the file ordered in time if the clock steps backwards. */
+    if (s.time < lastTime_) s.time = lastTime_;
+
+    if (!blockOpen_ || index_.back().count >= OXINSTIPS_HISTORY_BLOCK_SAMPLES) {
+        IndexEntry entry;
+        entry.time = s.time;
+        entry.offset = index_.empty() ? sizeof(Header) : (blockEnd(index_.back()) + 7) & ~(size_t)7;
+        entry.count = 0;
+        entry.bytes = 0;
+        if (!file_.reserve(entry.offset + sizeof(Block) + OXINSTIPS_CODEC_MAX_BYTES, OXINSTIPS_HISTORY_GROW_BYTES)) {
+            growFailed();
+            mutex_.unlock();
+            return false;
+        }
+        block(entry.offset)->firstTime = entry.time;
+        block(entry.offset)->fill = 0;
+        header()->lastBlock = entry.offset;
+        index_.push_back(entry);
+        encoder_.reset(entry.time);
+        blockOpen_ = true;
+    } else if (!file_.reserve(blockEnd(index_.back()) + OXINSTIPS_CODEC_MAX_BYTES, OXINSTIPS_HISTORY_GROW_BYTES)) {
+        growFailed();
+        mutex_.unlock();
+        return false;
+    }
+
+    IndexEntry &entry = index_.back();
+    entry.bytes += encoder_.encode(s, (unsigned char *)file_.base() + blockEnd(entry));
+    entry.count++;
+    /* Fill last and in one store, so a crash never leaves a partly written sample counted. */
+    block(entry.offset)->fill = blockFill(entry.bytes, entry.count);
+    count_++;
+    lastTime_ = s.time;
+    if (growFailed_) {
+        errlogPrintf("OxInstIPSHistory: %s recording again\n", fileName_.c_str());
+        growFailed_ = false;
+    }
+
+    for (int l = 0; l < OXINSTIPS_HISTORY_LEVELS; l++) {
+        addToLevel(l, s);
+    }
+    mutex_.unlock();
+    return true;
+}
+
+size_t OxInstIPSHistory::count()
+{
+    size_t count;
+
+    mutex_.lock();
+    count = count_;
+    mutex_.unlock();
+    return count;
+}
+
+/* Bytes of the file in use, for comparison with count() * sizeof(OxInstIPSHistorySample). */
+size_t OxInstIPSHistory::bytes()
+{
+    size_t bytes;
+
+    mutex_.lock();
+    bytes = index_.empty() ? sizeof(Header) : blockEnd(index_.back());
+    mutex_.unlock();
+    return bytes;
+}
+
+/* Called with the mutex held. */
+size_t OxInstIPSHistory::decodeBlock(size_t b, std::vector<OxInstIPSHistorySample> *samples)
+{
+    const IndexEntry &entry = index_[b];
+    const unsigned char *data = (const unsigned char *)file_.base() + entry.offset + sizeof(Block);
+    OxInstIPSSampleDecoder decoder;
+    size_t offset = 0;
+
+    samples->resize(entry.count);
+    decoder.reset(entry.time);
+    for (size_t n = 0; n < entry.count; n++) {
+        size_t used = decoder.decode(data + offset, entry.bytes - offset, &(*samples)[n]);
+        if (used == 0) {
+            samples->resize(n);
+            break;
+        }
+        offset += used;
+    }
+    return samples->size();
+}
+
+size_t OxInstIPSHistory::query(int channel, const epicsTimeStamp &start, const epicsTimeStamp &end,
+                               size_t decimation, size_t maxPoints,
+                               std::vector<double> *times, std::vector<double> *values)
+{
+    std::vector<int> channels(1, channel);
+    std::vector<std::vector<double> > channelValues;
+
+    query(channels, start, end, decimation, maxPoints, times, &channelValues);
+    values->swap(channelValues[0]);
+    return times->size();
+}
+
+/* The mutex is only held while one block is decoded, so a long query delays append()
+ * by at most OXINSTIPS_HISTORY_BLOCK_SAMPLES decodes. */
+size_t OxInstIPSHistory::query(const std::vector<int> &channels, const epicsTimeStamp &start,
+                               const epicsTimeStamp &end, size_t decimation, size_t maxPoints,
+                               std::vector<double> *times, std::vector<std::vector<double> > *values)
+{
+    epicsUInt64 startTime = toNanoseconds(start), endTime = toNanoseconds(end);
+    std::vector<OxInstIPSHistorySample> samples;
+    size_t matched = 0, first, last;
+
+    times->clear();
+    values->assign(channels.size(), std::vector<double>());
+    for (size_t c = 0; c < channels.size(); c++) {
+        if (channels[c] < 0 || channels[c] >= OXINSTIPS_HISTORY_CHANNELS) return 0;
+    }
+    if (decimation < 1) decimation = 1;
+
+    /* The last block starting at or before start holds the first sample wanted. */
+    mutex_.lock();
+    std::vector<IndexEntry>::const_iterator it =
+        std::lower_bound(index_.begin(), index_.end(), startTime + 1);
+    first = (it == index_.begin()) ? 0 : (size_t)(it - index_.begin()) - 1;
+    last = index_.size();
+    mutex_.unlock();
+
+    for (size_t b = first; b < last; b++) {
+        mutex_.lock();
+        if (!file_.isOpen() || b >= index_.size()) {
+            mutex_.unlock();
+            break;
+        }
+        decodeBlock(b, &samples);
+        mutex_.unlock();
+
+        for (size_t n = 0; n < samples.size(); n++) {
+            const OxInstIPSHistorySample &s = samples[n];
+            if (s.time < startTime) continue;
+            if (s.time > endTime || times->size() >= maxPoints) return times->size();
+            if (matched++ % decimation != 0) continue;
+            times->push_back(toPosixSeconds(s.time));
+            for (size_t c = 0; c < channels.size(); c++) {
+                int channel = channels[c];
+                double value;
+                if (channel < OXINSTIPS_HISTORY_VALUES) {
+                    value = s.values[channel];
+                } else if (s.statusValid) {
+                    value = s.status[channel - OXINSTIPS_HISTORY_VALUES];
+                } else {
+                    value = NAN;
+                }
+                (*values)[c].push_back(value);
+            }
+        }
+    }
+    return times->size();
+}
+
+static bool aggregateBefore(const OxInstIPSHistoryAggregate &a, epicsUInt64 time)
+{
+    return a.time < time;
+}
+
+static double statusValue(epicsUInt8 status)
+{
+    return (status == OXINSTIPS_HISTORY_NO_STATUS) ? NAN : status;
+}
+
+/* Status channels have a min and max but no mean. */
+size_t OxInstIPSHistory::queryLevel(const std::vector<int> &channels, int level,
+                                    const epicsTimeStamp &start, const epicsTimeStamp &end, size_t maxPoints,
+                                    std::vector<double> *times, std::vector<std::vector<double> > *mins,
+                                    std::vector<std::vector<double> > *maxs, std::vector<std::vector<double> > *means)
+{
+    epicsUInt64 startTime = toNanoseconds(start), endTime = toNanoseconds(end);
+
+    times->clear();
+    mins->assign(channels.size(), std::vector<double>());
+    maxs->assign(channels.size(), std::vector<double>());
+    means->assign(channels.size(), std::vector<double>());
+    if (level < 0 || level >= OXINSTIPS_HISTORY_LEVELS) return 0;
+    for (size_t c = 0; c < channels.size(); c++) {
+        if (channels[c] < 0 || channels[c] >= OXINSTIPS_HISTORY_CHANNELS) return 0;
+    }
+
+    mutex_.lock();
+    const Level &lev = levels_[level];
+    if (lev.file.isOpen()) {
+        /* Buckets overlapping the range start after startTime - width. */
+        epicsUInt64 after = (startTime >= lev.width) ? startTime - lev.width + 1 : 0;
+        const OxInstIPSHistoryAggregate *first = aggregate(level, 0), *last = aggregate(level, lev.count);
+        for (const OxInstIPSHistoryAggregate *a = std::lower_bound(first, last, after, aggregateBefore);
+             a != last && a->time <= endTime && times->size() < maxPoints; ++a) {
+            times->push_back(toPosixSeconds(a->time));
+            for (size_t c = 0; c < channels.size(); c++) {
+                int channel = channels[c];
+                if (channel < OXINSTIPS_HISTORY_VALUES) {
+                    (*mins)[c].push_back(a->min[channel]);
+                    (*maxs)[c].push_back(a->max[channel]);
+                    (*means)[c].push_back(a->mean[channel]);
+                } else {
+                    (*mins)[c].push_back(statusValue(a->statusMin[channel - OXINSTIPS_HISTORY_VALUES]));
+                    (*maxs)[c].push_back(statusValue(a->statusMax[channel - OXINSTIPS_HISTORY_VALUES]));
+                    (*means)[c].push_back(NAN);
+                }
+            }
+        }
+        const Bucket &bucket = lev.open;
+        if (bucket.count > 0 && bucket.time >= after && bucket.time <= endTime && times->size() < maxPoints) {
+            times->push_back(toPosixSeconds(bucket.time));
+            for (size_t c = 0; c < channels.size(); c++) {
+                int channel = channels[c];
+                if (channel < OXINSTIPS_HISTORY_VALUES) {
+                    bool valid = bucket.valid[channel] > 0;
+                    (*mins)[c].push_back(valid ? bucket.min[channel] : NAN);
+                    (*maxs)[c].push_back(valid ? bucket.max[channel] : NAN);
+                    (*means)[c].push_back(valid ? bucket.sum[channel] / bucket.valid[channel] : NAN);
+                } else {
+                    epicsUInt8 statusMin = bucket.statusMin[channel - OXINSTIPS_HISTORY_VALUES];
+                    (*mins)[c].push_back(statusValue(statusMin));
+                    (*maxs)[c].push_back(statusMin == OXINSTIPS_HISTORY_NO_STATUS ? NAN
+                                         : bucket.statusMax[channel - OXINSTIPS_HISTORY_VALUES]);
+                    (*means)[c].push_back(NAN);
+                }
+            }
+        }
+    }
+    mutex_.unlock();
+    return times->size();
+}
+
+int OxInstIPSHistory::chooseLevel(const epicsTimeStamp &start, const epicsTimeStamp &end, size_t maxPoints)
+{
+    epicsUInt64 startTime = toNanoseconds(start), endTime = toNanoseconds(end);
+    int level = OXINSTIPS_HISTORY_RAW;
+
+    if (endTime < startTime) return OXINSTIPS_HISTORY_RAW;
+    mutex_.lock();
+    /* Estimate the samples in range from the counts and times of the blocks that hold
+     * them, taking the share of a block at either end in proportion to the time in range.
+     * The walk stops as soon as the estimate is over maxPoints. */
+    std::vector<IndexEntry>::const_iterator it =
+        std::lower_bound(index_.begin(), index_.end(), startTime + 1);
+    double samples = 0.0;
+    for (size_t b = (it == index_.begin()) ? 0 : (size_t)(it - index_.begin()) - 1;
+         b < index_.size() && index_[b].time <= endTime && samples <= maxPoints; b++) {
+        const IndexEntry &entry = index_[b];
+        epicsUInt64 stop = (b + 1 < index_.size()) ? index_[b + 1].time : lastTime_ + 1;
+        epicsUInt64 from = entry.time > startTime ? entry.time : startTime;
+        epicsUInt64 to = stop < endTime + 1 ? stop : endTime + 1;
+        if (to > from && stop > entry.time) samples += (double)entry.count * (to - from) / (stop - entry.time);
+    }
+    if (samples > maxPoints) {
+        for (int l = 0; l < OXINSTIPS_HISTORY_LEVELS; l++) {
+            if (!levels_[l].file.isOpen()) continue;
+            level = l;
+            if ((endTime - startTime) / levels_[l].width + 1 <= maxPoints) break;
+        }
+    }
+    mutex_.unlock();
+    return level;
+}
@@ -0,0 +1,166 @@
+/* OxInstIPSHistory.h
+ *
+ * Append-only history of the readbacks of one IPS unit, kept in a memory-mapped file.
+ *
+ * Every poll appends one sample holding all the read parameters and the decoded X
+ * status, compressed with OxInstIPSSampleEncoder.  Samples are written in blocks of up to
+ * OXINSTIPS_HISTORY_BLOCK_SAMPLES, each of which starts a new encoder run and so can be
+ * decoded on its own.  An index in memory holds the first time and file offset of every
+ * block, so a time range query is a binary search of the index followed by decoding
+ * forward from one block.
+ *
+ * The file is grown in OXINSTIPS_HISTORY_GROW_BYTES steps.  The header records the
+ * offset of the last block and each block header its sample and byte counts, so the
+ * index can be rebuilt by walking the block headers when the file is reopened after an
+ * IOC restart.  Appending after a reopen starts a new block.
+ *
+ * For plotting long ranges the min, max and mean of every channel are also kept over
+ * buckets of 10 s, 1 min, 10 min and 1 h, each level in a file of fixed-size records
+ * beside the sample file.  They are updated as samples are appended, and on open are
+ * brought up to date from the samples, so deleting them just makes them be rebuilt.
+ */
+#ifndef OxInstIPSHistory_H
+#define OxInstIPSHistory_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "epicsMutex.h"
+#include "epicsTime.h"
+#include "epicsTypes.h"
+
+#include "OxInstIPSCodec.h"
+#include "OxInstIPSMappedFile.h"
+
+#define OXINSTIPS_HISTORY_BLOCK_SAMPLES 256
+#define OXINSTIPS_HISTORY_GROW_BYTES (16 * 1024 * 1024)
+
+/* Aggregate levels, kept in fileName.L0 ... fileName.L3. */
+#define OXINSTIPS_HISTORY_LEVELS 4
+#define OXINSTIPS_HISTORY_LEVEL_GROW_BYTES (1024 * 1024)
+
+/* Query resolutions other than a level number. */
+#define OXINSTIPS_HISTORY_RAW  (-1)
+#define OXINSTIPS_HISTORY_AUTO (-2)
+
+/* One bucket of an aggregate level.  Channels with no valid sample in the bucket hold
+ * NaN, and status digits 0xff. */
+struct OxInstIPSHistoryAggregate {
+    epicsUInt64 time;                                   /* bucket start, ns since the EPICS epoch */
+    epicsUInt32 count;                                  /* samples in the bucket */
+    epicsFloat32 min[OXINSTIPS_HISTORY_VALUES];
+    epicsFloat32 max[OXINSTIPS_HISTORY_VALUES];
+    epicsFloat32 mean[OXINSTIPS_HISTORY_VALUES];
+    epicsUInt8 statusMin[OXINSTIPS_HISTORY_STATUS];
+    epicsUInt8 statusMax[OXINSTIPS_HISTORY_STATUS];
+    epicsUInt8 reserved[6];
+};
+
+class OxInstIPSHistory {
+public:
+    OxInstIPSHistory();
+    ~OxInstIPSHistory();
+
+    bool open(const char *fileName);
+    void close();
+    bool isOpen() const { return file_.isOpen(); }
+
+    bool append(const OxInstIPSHistorySample &sample);
+
+    /* Samples of one channel with start <= time <= end, taking every decimation-th one,
+     * up to maxPoints.  Times are returned as seconds since the POSIX epoch. */
+    size_t query(int channel, const epicsTimeStamp &start, const epicsTimeStamp &end,
+                 size_t decimation, size_t maxPoints,
+                 std::vector<double> *times, std::vector<double> *values);
+
+    /* As above for several channels at once, with values[i] the samples of channels[i]. */
+    size_t query(const std::vector<int> &channels, const epicsTimeStamp &start,
+                 const epicsTimeStamp &end, size_t decimation, size_t maxPoints,
+                 std::vector<double> *times, std::vector<std::vector<double> > *values);
+
+    /* Min, max and mean of the buckets of one level overlapping start to end, up to
+     * maxPoints, including the bucket still being filled.  Times are bucket starts. */
+    size_t queryLevel(const std::vector<int> &channels, int level,
+                      const epicsTimeStamp &start, const epicsTimeStamp &end, size_t maxPoints,
+                      std::vector<double> *times, std::vector<std::vector<double> > *mins,
+                      std::vector<std::vector<double> > *maxs, std::vector<std::vector<double> > *means);
+
+    /* The finest resolution that returns no more than about maxPoints for the range:
+     * OXINSTIPS_HISTORY_RAW or a level number. */
+    int chooseLevel(const epicsTimeStamp &start, const epicsTimeStamp &end, size_t maxPoints);
+
+    size_t count();
+    size_t bytes();
+    const std::string &fileName() const { return fileName_; }
+
+    static double levelSeconds(int level);
+
+    /* Channel numbers are the order of the read parameters, then the status digits. */
+    static int channelIndex(const char *name);
+    static const char *channelName(int channel);
+
+    static epicsUInt64 toNanoseconds(const epicsTimeStamp &time);
+    static double toPosixSeconds(epicsUInt64 nanoseconds);
+    static epicsTimeStamp fromPosixSeconds(double seconds);
+    /* POSIX seconds, or values <= 0 for seconds relative to now. */
+    static epicsTimeStamp fromRequestSeconds(double seconds, const epicsTimeStamp &now);
+
+private:
+    struct Header;
+    struct Block;
+    struct LevelHeader;
+
+    struct IndexEntry {
+        epicsUInt64 time;       /* of the first sample */
+        size_t offset;          /* of the Block header in the file */
+        size_t count;
+        size_t bytes;
+        bool operator<(epicsUInt64 t) const { return time < t; }
+    };
+
+    /* The bucket being filled, kept in memory until a sample arrives for a later one. */
+    struct Bucket {
+        epicsUInt64 time;
+        size_t count;
+        double min[OXINSTIPS_HISTORY_VALUES];
+        double max[OXINSTIPS_HISTORY_VALUES];
+        double sum[OXINSTIPS_HISTORY_VALUES];
+        size_t valid[OXINSTIPS_HISTORY_VALUES];
+        epicsUInt8 statusMin[OXINSTIPS_HISTORY_STATUS];
+        epicsUInt8 statusMax[OXINSTIPS_HISTORY_STATUS];
+    };
+
+    struct Level {
+        OxInstIPSMappedFile file;
+        epicsUInt64 width;      /* ns */
+        size_t count;           /* closed buckets in the file */
+        Bucket open;
+    };
+
+    Header *header() const;
+    Block *block(size_t offset) const;
+    size_t blockEnd(const IndexEntry &entry) const;
+    size_t decodeBlock(size_t b, std::vector<OxInstIPSHistorySample> *samples);
+
+    bool openLevel(int level);
+    LevelHeader *levelHeader(int level) const;
+    OxInstIPSHistoryAggregate *aggregate(int level, size_t n) const;
+    void addToLevel(int level, const OxInstIPSHistorySample &sample);
+    void closeBucket(int level);
+    void growFailed();
+    void replayLevels();
+
+    epicsMutex mutex_;
+    std::string fileName_;
+    OxInstIPSMappedFile file_;
+    std::vector<IndexEntry> index_;
+    size_t count_;
+    epicsUInt64 lastTime_;
+    bool blockOpen_;
+    bool growFailed_;               /* the file could not grow: samples are being dropped */
+    OxInstIPSSampleEncoder encoder_;
+    Level levels_[OXINSTIPS_HISTORY_LEVELS];
+};
+
+#endif /* OxInstIPSHistory_H */
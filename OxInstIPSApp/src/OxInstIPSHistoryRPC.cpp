@@ -0,0 +1,308 @@
+/* OxInstIPSHistoryRPC.cpp
+ *
+ * pvAccess RPC service returning the readback history of one IPS unit, so that GUIs can
+ * pull a time range without going through the HIST:* records.
+ *
+ * Configure from the IOC shell, before iocInit, with
+ *   OxInstIPSHistoryRPCConfig(portName, pvName)
+ * after OxInstIPSHistoryConfig for the same port.  The PV is served by the IOC's own
+ * pvAccess server.  The arguments, either as a plain structure or as the query of an
+ * NTURI (as sent by "pvcall"), are
+ *   channels    string or string[], history channel names, e.g. "R2,R7"  (default R2)
+ *   start, end  POSIX seconds, or values <= 0 for seconds relative to now (default -3600, 0)
+ *   decimation  return every n-th sample                                 (default 1)
+ *   maxPoints   upper limit on the samples returned                       (default 100000)
+ *               at most OXINSTIPS_RPC_MAX_VALUES values in all columns together
+ *   resolution  "raw", "auto", or the bucket width in seconds of an aggregate level
+ *               (10, 60, 600 or 3600)                                     (default raw)
+ * and the result is an NTTable with a "time" column in POSIX seconds and one column per
+ * channel; a channel named twice gets one column.  For aggregates the times are bucket
+ * starts, the channel columns hold the bucket means, and <channel>_min and <channel>_max
+ * columns are added.  The descriptor says which resolution was used.  A request with an
+ * argument that is not understood fails with an error status.  A get on the PV returns
+ * the list of channel names.
+ *
+ * Requests are served on the pvAccess server threads.  The history lock is taken for one
+ * block of samples at a time, so the poll thread is never held up by a long query.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pv/pvData.h>
+#include <pv/pvAccess.h>
+#include <pva/server.h>
+#include <pva/sharedstate.h>
+
+#include "epicsTime.h"
+#include "iocsh.h"
+
+#include "OxInstIPSDriver.h"
+
+#include "epicsExport.h"
+
+namespace pvd = epics::pvData;
+namespace pva = epics::pvAccess;
+
+/* Values in one reply, times included: 32 MB of doubles. */
+#define OXINSTIPS_RPC_MAX_VALUES 4000000
+
+class OxInstIPSHistoryRPC : public pvas::SharedPV::Handler {
+public:
+    explicit OxInstIPSHistoryRPC(OxInstIPSDriver *driver) : driver_(driver) {}
+    virtual ~OxInstIPSHistoryRPC() {}
+
+    virtual void onRPC(const pvas::SharedPV::shared_pointer &pv, pvas::Operation &op);
+
+private:
+    void reply(pvas::Operation &op, const std::vector<std::string> &names, int level,
+               const std::vector<double> &times, const std::vector<std::vector<double> > &values,
+               const std::vector<std::vector<double> > &mins, const std::vector<std::vector<double> > &maxs);
+
+    OxInstIPSDriver *driver_;
+};
+
+/* OXINSTIPS_HISTORY_RAW, OXINSTIPS_HISTORY_AUTO or a level, or -3 if not understood. */
+static int argResolution(const pvd::PVStructure &args)
+{
+    pvd::PVScalar::const_shared_pointer field = args.getSubField<pvd::PVScalar>("resolution");
+    if (!field) return OXINSTIPS_HISTORY_RAW;
+    std::string text = field->getAs<std::string>();
+    if (text == "raw") return OXINSTIPS_HISTORY_RAW;
+    if (text == "auto") return OXINSTIPS_HISTORY_AUTO;
+    double seconds = field->getAs<double>();
+    for (int level = 0; level < OXINSTIPS_HISTORY_LEVELS; level++) {
+        if (seconds == OxInstIPSHistory::levelSeconds(level)) return level;
+    }
+    return -3;
+}
+
+/* A finite number, or defaultValue if the argument is absent.  Throws std::runtime_error
+ * naming the argument if it is not a number. */
+static double argDouble(const pvd::PVStructure &args, const char *name, double defaultValue)
+{
+    pvd::PVScalar::const_shared_pointer field = args.getSubField<pvd::PVScalar>(name);
+    double value = defaultValue;
+
+    if (field) {
+        try {
+            value = field->getAs<double>();
+        } catch (std::exception &) {
+            value = NAN;
+        }
+    }
+    if (!isfinite(value)) throw std::runtime_error(std::string(name) + " must be a number");
+    return value;
+}
+
+/* Channel names from a string array, or a comma or space separated string. */
+static std::vector<std::string> argChannels(const pvd::PVStructure &args)
+{
+    std::vector<std::string> names;
+    pvd::PVScalarArray::const_shared_pointer array = args.getSubField<pvd::PVScalarArray>("channels");
+    pvd::PVScalar::const_shared_pointer scalar = args.getSubField<pvd::PVScalar>("channels");
+
+    if (array) {
+        pvd::shared_vector<const std::string> values;
+        array->getAs<std::string>(values);
+        names.assign(values.begin(), values.end());
+    } else if (scalar) {
+        std::string list = scalar->getAs<std::string>();
+        size_t pos = 0;
+        while (pos < list.size()) {
+            size_t next = list.find_first_of(", ", pos);
+            if (next == std::string::npos) next = list.size();
+            if (next > pos) names.push_back(list.substr(pos, next - pos));
+            pos = next + 1;
+        }
+    }
+    if (names.empty()) names.push_back("R2");
+    return names;
+}
+
+static void setColumn(const pvd::PVStructurePtr &result, const std::string &name,
+                      const std::vector<double> &data)
+{
+    pvd::PVDoubleArray::svector column(data.size());
+    std::copy(data.begin(), data.end(), column.begin());
+    result->getSubFieldT<pvd::PVDoubleArray>(name)->replace(pvd::freeze(column));
+}
+
+void OxInstIPSHistoryRPC::onRPC(const pvas::SharedPV::shared_pointer & /*pv*/, pvas::Operation &op)
+{
+    OxInstIPSHistory &history = driver_->history();
+    const pvd::PVStructure &request = op.value();
+    pvd::PVStructure::const_shared_pointer query = request.getSubField<pvd::PVStructure>("query");
+    const pvd::PVStructure &args = query ? *query : request;
+    std::vector<std::string> names;
+    std::vector<int> channels;
+    std::vector<double> times;
+    std::vector<std::vector<double> > values, mins, maxs;
+    epicsTimeStamp now, start, end;
+    double decimation, maxPoints;
+    int level;
+
+    if (!history.isOpen()) {
+        op.complete(pvd::Status::error("no history file for this unit"));
+        return;
+    }
+
+    /* Every argument is checked before any work is done. */
+    try {
+        std::vector<std::string> requested = argChannels(args);
+        for (size_t i = 0; i < requested.size(); i++) {
+            int channel = OxInstIPSHistory::channelIndex(requested[i].c_str());
+            if (channel < 0) throw std::runtime_error("unknown channel " + requested[i]);
+            if (std::find(channels.begin(), channels.end(), channel) != channels.end()) continue;
+            channels.push_back(channel);
+            names.push_back(requested[i]);
+        }
+        try {
+            level = argResolution(args);
+        } catch (std::exception &) {
+            level = -3;
+        }
+        if (level == -3) throw std::runtime_error("resolution must be raw, auto, 10, 60, 600 or 3600");
+        decimation = argDouble(args, "decimation", 1.0);
+        maxPoints = argDouble(args, "maxPoints", 100000.0);
+        epicsTimeGetCurrent(&now);
+        start = OxInstIPSHistory::fromRequestSeconds(argDouble(args, "start", -3600.0), now);
+        end = OxInstIPSHistory::fromRequestSeconds(argDouble(args, "end", 0.0), now);
+    } catch (std::exception &e) {
+        op.complete(pvd::Status::error(e.what()));
+        return;
+    }
+
+    /* Aggregates have three columns per channel. */
+    double maxRows = OXINSTIPS_RPC_MAX_VALUES / (1.0 + 3.0 * channels.size());
+    if (decimation < 1.0) decimation = 1.0;
+    if (decimation > 1e9) decimation = 1e9;
+    if (maxPoints < 1.0) maxPoints = 1.0;
+    if (maxPoints > maxRows) maxPoints = maxRows;
+
+    if (level == OXINSTIPS_HISTORY_AUTO) level = history.chooseLevel(start, end, (size_t)maxPoints);
+    if (level == OXINSTIPS_HISTORY_RAW) {
+        history.query(channels, start, end, (size_t)decimation, (size_t)maxPoints, &times, &values);
+    } else {
+        history.queryLevel(channels, level, start, end, (size_t)maxPoints, &times, &mins, &maxs, &values);
+    }
+    reply(op, names, level, times, values, mins, maxs);
+}
+
+void OxInstIPSHistoryRPC::reply(pvas::Operation &op, const std::vector<std::string> &names, int level,
+                                const std::vector<double> &times, const std::vector<std::vector<double> > &values,
+                                const std::vector<std::vector<double> > &mins,
+                                const std::vector<std::vector<double> > &maxs)
+{
+    bool aggregates = (level != OXINSTIPS_HISTORY_RAW);
+
+    pvd::FieldBuilderPtr builder = pvd::getFieldCreate()->createFieldBuilder();
+    builder = builder->setId("epics:nt/NTTable:1.0")
+                     ->addArray("labels", pvd::pvString)
+                     ->add("descriptor", pvd::pvString)
+                     ->addNestedStructure("value")
+                     ->addArray("time", pvd::pvDouble);
+    for (size_t i = 0; i < names.size(); i++) {
+        builder = builder->addArray(names[i], pvd::pvDouble);
+        if (aggregates) {
+            builder = builder->addArray(names[i] + "_min", pvd::pvDouble)
+                             ->addArray(names[i] + "_max", pvd::pvDouble);
+        }
+    }
+    pvd::PVStructurePtr result = pvd::getPVDataCreate()->createPVStructure(
+        builder->endNested()->createStructure());
+
+    pvd::PVStringArray::svector labels;
+    labels.push_back("time");
+    for (size_t i = 0; i < names.size(); i++) {
+        labels.push_back(names[i]);
+        if (aggregates) {
+            labels.push_back(names[i] + "_min");
+            labels.push_back(names[i] + "_max");
+        }
+    }
+    result->getSubFieldT<pvd::PVStringArray>("labels")->replace(pvd::freeze(labels));
+    char descriptor[40];
+    if (aggregates) sprintf(descriptor, "%g s buckets", OxInstIPSHistory::levelSeconds(level));
+    else strcpy(descriptor, "raw samples");
+    result->getSubFieldT<pvd::PVString>("descriptor")->put(descriptor);
+
+    setColumn(result, "value.time", times);
+    for (size_t i = 0; i < names.size(); i++) {
+        setColumn(result, "value." + names[i], values[i]);
+        if (aggregates) {
+            setColumn(result, "value." + names[i] + "_min", mins[i]);
+            setColumn(result, "value." + names[i] + "_max", maxs[i]);
+        }
+    }
+    op.complete(*result, pvd::BitSet().set(0));
+}
+
+/* One provider for all units, added to the IOC's pvAccess server on first use. */
+static pvas::StaticProvider *historyProvider(void)
+{
+    static pvas::StaticProvider *provider = NULL;
+
+    if (provider == NULL) {
+        provider = new pvas::StaticProvider("OxInstIPSHistory");
+        pva::ChannelProviderRegistry::servers()->addSingleton(provider->provider());
+    }
+    return provider;
+}
+
+extern "C" {
+
+int OxInstIPSHistoryRPCConfig(const char *portName, const char *pvName)
+{
+    OxInstIPSDriver *pIPS = dynamic_cast<OxInstIPSDriver *>(
+        static_cast<asynPortDriver *>(findAsynPortDriver(portName)));
+
+    if (pIPS == NULL) {
+        printf("OxInstIPSHistoryRPCConfig: %s is not an OxInstIPS port\n", portName);
+        return asynError;
+    }
+    if (pvName == NULL || pvName[0] == '\0') {
+        printf("OxInstIPSHistoryRPCConfig: no PV name given\n");
+        return asynError;
+    }
+
+    pvd::StructureConstPtr type = pvd::getFieldCreate()->createFieldBuilder()
+        ->addArray("channels", pvd::pvString)
+        ->createStructure();
+    pvd::PVStructurePtr info = pvd::getPVDataCreate()->createPVStructure(type);
+    pvd::PVStringArray::svector channels;
+    for (int i = 0; i < OXINSTIPS_HISTORY_CHANNELS; i++) {
+        channels.push_back(OxInstIPSHistory::channelName(i));
+    }
+    info->getSubFieldT<pvd::PVStringArray>("channels")->replace(pvd::freeze(channels));
+
+    pvas::SharedPV::shared_pointer pv = pvas::SharedPV::build(
+        pvas::SharedPV::Handler::shared_pointer(new OxInstIPSHistoryRPC(pIPS)));
+    pv->open(*info);
+    historyProvider()->add(pvName, pv);
+    return asynSuccess;
+}
+
+static const iocshArg rpcArg0 = { "portName", iocshArgString };
+static const iocshArg rpcArg1 = { "pvName", iocshArgString };
+static const iocshArg * const rpcArgs[] = { &rpcArg0, &rpcArg1 };
+static const iocshFuncDef rpcFuncDef = { "OxInstIPSHistoryRPCConfig", 2, rpcArgs };
+
+static void rpcCallFunc(const iocshArgBuf *args)
+{
+    OxInstIPSHistoryRPCConfig(args[0].sval, args[1].sval);
+}
+
+void OxInstIPSHistoryRPCRegister(void)
+{
+    iocshRegister(&rpcFuncDef, rpcCallFunc);
+}
+
+epicsExportRegistrar(OxInstIPSHistoryRPCRegister);
+
+}
@@ -0,0 +1,50 @@
+/* OxInstIPSKalman.cpp
+ *
+ * Kalman filter for the magnet current.  See OxInstIPSKalman.h.
+ */
+#include "OxInstIPSKalman.h"
+
+OxInstIPSKalman::OxInstIPSKalman()
+    : valid_(false), measurementVariance_(0.0), restProcessVariance_(0.0),
+      sweepProcessVariance_(0.0), lastDemand_(0.0), current_(0.0), variance_(0.0), gain_(0.0)
+{
+}
+
+void OxInstIPSKalman::setNoise(double measurementNoise, double restProcessNoise, double sweepProcessNoise)
+{
+    measurementVariance_ = measurementNoise * measurementNoise;
+    restProcessVariance_ = restProcessNoise * restProcessNoise;
+    sweepProcessVariance_ = sweepProcessNoise * sweepProcessNoise;
+}
+
+void OxInstIPSKalman::reset()
+{
+    valid_ = false;
+}
+
+void OxInstIPSKalman::update(double demandCurrent, double measuredCurrent, bool sweeping)
+{
+    double predicted, predictedVariance;
+
+    if (!valid_) {
+        /* Start from the first measurement with its own uncertainty. */
+        valid_ = true;
+        lastDemand_ = demandCurrent;
+        current_ = measuredCurrent;
+        variance_ = measurementVariance_;
+        gain_ = 1.0;
+        return;
+    }
+
+    predicted = current_ + (demandCurrent - lastDemand_);
+    predictedVariance = variance_ + (sweeping ? sweepProcessVariance_ : restProcessVariance_);
+    lastDemand_ = demandCurrent;
+
+    if (predictedVariance + measurementVariance_ > 0.0) {
+        gain_ = predictedVariance / (predictedVariance + measurementVariance_);
+    } else {
+        gain_ = 1.0;
+    }
+    current_ = predicted + gain_ * (measuredCurrent - predicted);
+    variance_ = (1.0 - gain_) * predictedVariance;
+}
@@ -0,0 +1,38 @@
+/* OxInstIPSKalman.h
+ *
+ * One-dimensional Kalman filter for the magnet current.  The measured current (R2)
+ * follows the demand current (R0), so each step predicts the magnet current to move by
+ * the change in demand since the last sample and then corrects the prediction with R2.
+ * The process noise is larger while sweeping, when the magnet lags the demand, than at
+ * rest.  Each step is constant time.
+ */
+#ifndef OxInstIPSKalman_H
+#define OxInstIPSKalman_H
+
+class OxInstIPSKalman {
+public:
+    OxInstIPSKalman();
+
+    /* Noise levels are standard deviations in amps, per sample for the process noise. */
+    void setNoise(double measurementNoise, double restProcessNoise, double sweepProcessNoise);
+    void reset();
+
+    void update(double demandCurrent, double measuredCurrent, bool sweeping);
+
+    bool valid() const { return valid_; }
+    double current() const { return current_; }
+    double variance() const { return variance_; }
+    double gain() const { return gain_; }
+
+private:
+    bool valid_;
+    double measurementVariance_;
+    double restProcessVariance_;
+    double sweepProcessVariance_;
+    double lastDemand_;
+    double current_;
+    double variance_;
+    double gain_;
+};
+
+#endif /* OxInstIPSKalman_H */
@@ -0,0 +1,200 @@
+/* OxInstIPSMappedFile.cpp
+ *
+ * A file mapped read/write into memory.  See OxInstIPSMappedFile.h.
+ */
+#include <stddef.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__) || defined(__APPLE__)
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "OxInstIPSMappedFile.h"
+
+OxInstIPSMappedFile::OxInstIPSMappedFile()
+    : base_(NULL), mappedSize_(0)
+#ifdef _WIN32
+    , file_(INVALID_HANDLE_VALUE), mapping_(NULL)
+#else
+    , fd_(-1)
+#endif
+{
+}
+
+OxInstIPSMappedFile::~OxInstIPSMappedFile()
+{
+    close();
+}
+
+#if defined(_WIN32)
+
+bool OxInstIPSMappedFile::open(const char *fileName, size_t initialSize, size_t *existingSize)
+{
+    LARGE_INTEGER fileSize;
+
+    close();
+    file_ = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if ((HANDLE)file_ == INVALID_HANDLE_VALUE) return false;
+    GetFileSizeEx((HANDLE)file_, &fileSize);
+    *existingSize = (size_t)fileSize.QuadPart;
+    if (!map(*existingSize > initialSize ? *existingSize : initialSize)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void OxInstIPSMappedFile::close()
+{
+    unmap();
+    if ((HANDLE)file_ != INVALID_HANDLE_VALUE) CloseHandle((HANDLE)file_);
+    file_ = INVALID_HANDLE_VALUE;
+}
+
+/* Mapping a section larger than the file extends the file, with the space allocated,
+ * so a full disk fails here rather than on a write through the view.  The old view is
+ * kept until the new one exists. */
+bool OxInstIPSMappedFile::map(size_t size)
+{
+    LARGE_INTEGER length;
+
+    length.QuadPart = (LONGLONG)size;
+    HANDLE mapping = CreateFileMappingA((HANDLE)file_, NULL, PAGE_READWRITE,
+                                        length.HighPart, length.LowPart, NULL);
+    if (mapping == NULL) return false;
+    char *base = (char *)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (base == NULL) {
+        CloseHandle(mapping);
+        return false;
+    }
+    unmap();
+    mapping_ = mapping;
+    base_ = base;
+    mappedSize_ = size;
+    return true;
+}
+
+void OxInstIPSMappedFile::unmap()
+{
+    if (base_) UnmapViewOfFile(base_);
+    if (mapping_) CloseHandle((HANDLE)mapping_);
+    base_ = NULL;
+    mapping_ = NULL;
+    mappedSize_ = 0;
+}
+
+#elif defined(__linux__) || defined(__APPLE__)
+
+bool OxInstIPSMappedFile::open(const char *fileName, size_t initialSize, size_t *existingSize)
+{
+    struct stat st;
+
+    close();
+    fd_ = ::open(fileName, O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) return false;
+    if (fstat(fd_, &st) != 0) {
+        close();
+        return false;
+    }
+    *existingSize = (size_t)st.st_size;
+    if (!map(*existingSize > initialSize ? *existingSize : initialSize)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void OxInstIPSMappedFile::close()
+{
+    unmap();
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+}
+
+/* Allocates the blocks from offset to the end of the file, so that writes through the
+ * mapping cannot find the disk full, which would raise SIGBUS. */
+static bool allocate(int fd, off_t offset, off_t end)
+{
+#ifdef __APPLE__
+    /* No posix_fallocate: write the zeros. */
+    static const char zeros[4096] = { 0 };
+    while (offset < end) {
+        size_t n = end - offset < (off_t)sizeof(zeros) ? (size_t)(end - offset) : sizeof(zeros);
+        ssize_t written = pwrite(fd, zeros, n, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        offset += written;
+    }
+    return true;
+#else
+    return posix_fallocate(fd, offset, end - offset) == 0;
+#endif
+}
+
+/* The old mapping is kept until the new one exists. */
+bool OxInstIPSMappedFile::map(size_t size)
+{
+    struct stat st;
+
+    if (fstat(fd_, &st) != 0) return false;
+    if ((size_t)st.st_size < size && !allocate(fd_, st.st_size, (off_t)size)) {
+        /* Give back anything allocated; the file keeps its old length. */
+        int result = ftruncate(fd_, st.st_size);
+        (void)result;
+        return false;
+    }
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (base == MAP_FAILED) return false;
+    unmap();
+    base_ = (char *)base;
+    mappedSize_ = size;
+    return true;
+}
+
+void OxInstIPSMappedFile::unmap()
+{
+    if (base_) munmap(base_, mappedSize_);
+    base_ = NULL;
+    mappedSize_ = 0;
+}
+
+#else
+
+/* No memory-mapped files on this target: the history cannot be opened. */
+bool OxInstIPSMappedFile::open(const char *, size_t, size_t *)
+{
+    return false;
+}
+
+void OxInstIPSMappedFile::close()
+{
+}
+
+bool OxInstIPSMappedFile::map(size_t)
+{
+    return false;
+}
+
+void OxInstIPSMappedFile::unmap()
+{
+}
+
+#endif
+
+/* If the file cannot grow the old mapping stays, so the owner can go on reading it and
+ * try again later. */
+bool OxInstIPSMappedFile::reserve(size_t size, size_t growBytes)
+{
+    if (size <= mappedSize_) return true;
+    size_t newSize = mappedSize_;
+    while (newSize < size) newSize += growBytes;
+    return map(newSize);
+}
@@ -0,0 +1,43 @@
+/* OxInstIPSMappedFile.h
+ *
+ * A file mapped read/write into memory, grown on demand.  Used for the history files.
+ * Not locked: the owner serialises access.
+ */
+#ifndef OxInstIPSMappedFile_H
+#define OxInstIPSMappedFile_H
+
+#include <stddef.h>
+
+class OxInstIPSMappedFile {
+public:
+    OxInstIPSMappedFile();
+    ~OxInstIPSMappedFile();
+
+    /* Opens or creates fileName and maps all of it, extending it to at least
+     * initialSize.  *existingSize is set to the length of the file before it was opened. */
+    bool open(const char *fileName, size_t initialSize, size_t *existingSize);
+    void close();
+    bool isOpen() const { return base_ != NULL; }
+
+    /* Grows the file in growBytes steps until at least size bytes are mapped.  Pointers
+     * into the old mapping are invalid afterwards. */
+    bool reserve(size_t size, size_t growBytes);
+
+    char *base() const { return base_; }
+    size_t size() const { return mappedSize_; }
+
+private:
+    bool map(size_t size);
+    void unmap();
+
+    char *base_;
+    size_t mappedSize_;
+#ifdef _WIN32
+    void *file_;
+    void *mapping_;
+#else
+    int fd_;
+#endif
+};
+
+#endif /* OxInstIPSMappedFile_H */
@@ -0,0 +1,389 @@
+/* OxInstIPSMetrics.cpp
+ *
+ * Driver performance counters and their OpenMetrics export.  See OxInstIPSMetrics.h.
+ */
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <map>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+/* A client that hangs up mid-scrape must not kill the IOC with SIGPIPE.  Linux has
+ * MSG_NOSIGNAL for send(); macOS has the SO_NOSIGPIPE socket option instead. */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#include "epicsStdio.h"
+#include "epicsThread.h"
+#include "epicsTime.h"
+#include "iocsh.h"
+
+#include "OxInstIPSDriver.h"
+#include "OxInstIPSMetrics.h"
+
+#include "epicsExport.h"
+
+/* A transaction is a few characters each way at 9600 baud, so about 10 ms when all
+ * is well; the reply timeout is 5 s. */
+const double OxInstIPSCounters::rttBounds[OXINSTIPS_RTT_BUCKETS] = {
+    0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0
+};
+
+const char *OxInstIPSCounters::outcomeName(Outcome outcome)
+{
+    static const char *names[NumOutcomes] = { "ok", "timeout", "error", "rejected" };
+    return names[outcome];
+}
+
+OxInstIPSCounters::OxInstIPSCounters()
+{
+    memset(&values_, 0, sizeof(values_));
+}
+
+void OxInstIPSCounters::addTransaction(Outcome outcome, double rtt, double busy)
+{
+    size_t bucket = 0;
+
+    while (bucket < OXINSTIPS_RTT_BUCKETS && rtt > rttBounds[bucket]) bucket++;
+    mutex_.lock();
+    values_.outcomes[outcome]++;
+    values_.rtt[bucket]++;
+    values_.rttSum += rtt;
+    values_.busy += busy;
+    mutex_.unlock();
+}
+
+void OxInstIPSCounters::addParseError()
+{
+    mutex_.lock();
+    values_.parseErrors++;
+    mutex_.unlock();
+}
+
+OxInstIPSCounters::Values OxInstIPSCounters::values() const
+{
+    mutex_.lock();
+    Values values = values_;
+    mutex_.unlock();
+    return values;
+}
+
+static void appendf(std::string &text, const char *format, ...) EPICS_PRINTF_STYLE(2, 3);
+
+static void appendf(std::string &text, const char *format, ...)
+{
+    char line[256];
+    va_list args;
+
+    va_start(args, format);
+    epicsVsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    text += line;
+}
+
+static void appendFamily(std::string &text, const char *name, const char *type, const char *unit,
+                         const char *help)
+{
+    appendf(text, "# TYPE %s %s\n", name, type);
+    if (unit) appendf(text, "# UNIT %s %s\n", name, unit);
+    appendf(text, "# HELP %s %s\n", name, help);
+}
+
+/* Port names are asyn port names, which need no escaping in a label value. */
+void OxInstIPSFormatMetrics(const std::vector<OxInstIPSMetricsSample> &samples, std::string &text)
+{
+    size_t i;
+
+    appendFamily(text, "oxinstips_transactions", "counter", NULL, "Command and reply transactions with the IPS.");
+    for (i = 0; i < samples.size(); i++) {
+        const OxInstIPSMetricsSample &s = samples[i];
+        for (int o = 0; o < OxInstIPSCounters::NumOutcomes; o++) {
+            appendf(text, "oxinstips_transactions_total{port=\"%s\",outcome=\"%s\"} %llu\n", s.port.c_str(),
+                    OxInstIPSCounters::outcomeName((OxInstIPSCounters::Outcome)o),
+                    (unsigned long long)s.counters.outcomes[o]);
+        }
+    }
+    appendFamily(text, "oxinstips_parse_errors", "counter", NULL, "Replies that could not be parsed.");
+    for (i = 0; i < samples.size(); i++) {
+        appendf(text, "oxinstips_parse_errors_total{port=\"%s\"} %llu\n", samples[i].port.c_str(),
+                (unsigned long long)samples[i].counters.parseErrors);
+    }
+    appendFamily(text, "oxinstips_rtt_seconds", "histogram", "seconds", "Transaction round trip time.");
+    for (i = 0; i < samples.size(); i++) {
+        const OxInstIPSMetricsSample &s = samples[i];
+        epicsUInt64 cumulative = 0;
+        for (size_t b = 0; b < OXINSTIPS_RTT_BUCKETS; b++) {
+            cumulative += s.counters.rtt[b];
+            appendf(text, "oxinstips_rtt_seconds_bucket{port=\"%s\",le=\"%g\"} %llu\n", s.port.c_str(),
+                    OxInstIPSCounters::rttBounds[b], (unsigned long long)cumulative);
+        }
+        cumulative += s.counters.rtt[OXINSTIPS_RTT_BUCKETS];
+        appendf(text, "oxinstips_rtt_seconds_bucket{port=\"%s\",le=\"+Inf\"} %llu\n", s.port.c_str(),
+                (unsigned long long)cumulative);
+        appendf(text, "oxinstips_rtt_seconds_count{port=\"%s\"} %llu\n", s.port.c_str(),
+                (unsigned long long)cumulative);
+        appendf(text, "oxinstips_rtt_seconds_sum{port=\"%s\"} %.6f\n", s.port.c_str(), s.counters.rttSum);
+    }
+    appendFamily(text, "oxinstips_bus_busy_seconds", "counter", "seconds",
+                 "Time the serial port was in use, including the command gap.");
+    for (i = 0; i < samples.size(); i++) {
+        appendf(text, "oxinstips_bus_busy_seconds_total{port=\"%s\"} %.6f\n", samples[i].port.c_str(),
+                samples[i].counters.busy);
+    }
+    appendFamily(text, "oxinstips_bus_utilisation_ratio", "gauge", "ratio",
+                 "Fraction of the time since the previous export the serial port was in use.");
+    for (i = 0; i < samples.size(); i++) {
+        appendf(text, "oxinstips_bus_utilisation_ratio{port=\"%s\"} %.4f\n", samples[i].port.c_str(),
+                samples[i].utilisation);
+    }
+    appendFamily(text, "oxinstips_poll_cycles", "counter", NULL, "Poll cycles completed.");
+    for (i = 0; i < samples.size(); i++) {
+        appendf(text, "oxinstips_poll_cycles_total{port=\"%s\"} %u\n", samples[i].port.c_str(),
+                samples[i].pollCycles);
+    }
+    appendFamily(text, "oxinstips_poll_overruns", "counter", NULL, "Poll cycles longer than the deadline.");
+    for (i = 0; i < samples.size(); i++) {
+        appendf(text, "oxinstips_poll_overruns_total{port=\"%s\"} %u\n", samples[i].port.c_str(),
+                samples[i].pollOverruns);
+    }
+    appendFamily(text, "oxinstips_poll_misses", "counter", NULL, "Reads more than a period late.");
+    for (i = 0; i < samples.size(); i++) {
+        appendf(text, "oxinstips_poll_misses_total{port=\"%s\"} %u\n", samples[i].port.c_str(),
+                samples[i].pollMisses);
+    }
+    appendFamily(text, "oxinstips_queue_depth", "gauge", NULL,
+                 "Reads left for the next poll cycle, and setpoint and settle waits queued.");
+    for (i = 0; i < samples.size(); i++) {
+        appendf(text, "oxinstips_queue_depth{port=\"%s\",queue=\"reads\"} %d\n", samples[i].port.c_str(),
+                samples[i].deferred);
+        appendf(text, "oxinstips_queue_depth{port=\"%s\",queue=\"waiters\"} %d\n", samples[i].port.c_str(),
+                samples[i].waiters);
+    }
+    appendFamily(text, "oxinstips_poll_shed", "gauge", NULL,
+                 "Priorities polled less often because of overload.");
+    for (i = 0; i < samples.size(); i++) {
+        appendf(text, "oxinstips_poll_shed{port=\"%s\"} %d\n", samples[i].port.c_str(), samples[i].shed);
+    }
+    appendFamily(text, "oxinstips_stale", "gauge", NULL, "Read parameters stuck at one value.");
+    for (i = 0; i < samples.size(); i++) {
+        appendf(text, "oxinstips_stale{port=\"%s\"} %d\n", samples[i].port.c_str(), samples[i].stale);
+    }
+    appendFamily(text, "oxinstips_poll_alive", "gauge", NULL, "1 while the poll loop is cycling.");
+    for (i = 0; i < samples.size(); i++) {
+        appendf(text, "oxinstips_poll_alive{port=\"%s\"} %d\n", samples[i].port.c_str(), samples[i].alive);
+    }
+    text += "# EOF\n";
+}
+
+/* Collects the metrics of every driver each interval and writes them to a file, or keeps
+ * them for a socket server thread to hand out. */
+class OxInstIPSMetricsExporter {
+public:
+    OxInstIPSMetricsExporter(const char *target, double interval);
+    bool start();
+    void exportTask();
+    void serveTask();
+
+private:
+    struct Busy {
+        double busy;
+        epicsTimeStamp time;
+    };
+
+    void collect(std::string &text);
+    bool writeFile(const std::string &text);
+
+    std::string fileName_;
+    std::string socketPath_;
+    double interval_;
+    std::map<std::string, Busy> lastBusy_;
+    epicsMutex mutex_;
+    std::string text_;
+    int listenFd_;
+};
+
+static const char *exporterName = "OxInstIPSMetrics";
+
+static void exportTaskC(void *pvt)
+{
+    static_cast<OxInstIPSMetricsExporter *>(pvt)->exportTask();
+}
+
+static void serveTaskC(void *pvt)
+{
+    static_cast<OxInstIPSMetricsExporter *>(pvt)->serveTask();
+}
+
+OxInstIPSMetricsExporter::OxInstIPSMetricsExporter(const char *target, double interval)
+    : interval_(interval), listenFd_(-1)
+{
+    if (strncmp(target, "unix:", 5) == 0) socketPath_ = target + 5;
+    else fileName_ = target;
+}
+
+bool OxInstIPSMetricsExporter::start()
+{
+    if (!socketPath_.empty()) {
+#ifdef _WIN32
+        printf("%s: Unix sockets are not supported here\n", exporterName);
+        return false;
+#else
+        struct sockaddr_un address;
+
+        if (socketPath_.size() >= sizeof(address.sun_path)) {
+            printf("%s: socket path %s too long\n", exporterName, socketPath_.c_str());
+            return false;
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, socketPath_.c_str());
+        unlink(socketPath_.c_str());
+        listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd_ < 0 || bind(listenFd_, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+            listen(listenFd_, 4) != 0) {
+            printf("%s: cannot listen on %s: %s\n", exporterName, socketPath_.c_str(), strerror(errno));
+            if (listenFd_ >= 0) close(listenFd_);
+            listenFd_ = -1;
+            return false;
+        }
+        if (epicsThreadCreate("OxInstIPSMetricsServe", epicsThreadPriorityLow,
+                              epicsThreadGetStackSize(epicsThreadStackSmall),
+                              (EPICSTHREADFUNC)serveTaskC, this) == NULL) {
+            printf("%s: epicsThreadCreate failure\n", exporterName);
+            return false;
+        }
+#endif
+    }
+    if (epicsThreadCreate("OxInstIPSMetrics", epicsThreadPriorityLow,
+                          epicsThreadGetStackSize(epicsThreadStackSmall),
+                          (EPICSTHREADFUNC)exportTaskC, this) == NULL) {
+        printf("%s: epicsThreadCreate failure\n", exporterName);
+        return false;
+    }
+    return true;
+}
+
+void OxInstIPSMetricsExporter::collect(std::string &text)
+{
+    std::vector<OxInstIPSDriver *> drivers = OxInstIPSDriver::drivers();
+    std::vector<OxInstIPSMetricsSample> samples(drivers.size());
+    epicsTimeStamp now;
+
+    epicsTimeGetCurrent(&now);
+    for (size_t i = 0; i < drivers.size(); i++) {
+        OxInstIPSMetricsSample &sample = samples[i];
+        drivers[i]->getMetrics(&sample);
+        std::map<std::string, Busy>::iterator last = lastBusy_.find(sample.port);
+        sample.utilisation = 0.0;
+        if (last != lastBusy_.end()) {
+            double elapsed = epicsTimeDiffInSeconds(&now, &last->second.time);
+            if (elapsed > 0.0) sample.utilisation = (sample.counters.busy - last->second.busy) / elapsed;
+        }
+        Busy busy = { sample.counters.busy, now };
+        lastBusy_[sample.port] = busy;
+    }
+    OxInstIPSFormatMetrics(samples, text);
+}
+
+/* Written to a temporary file and renamed, so a reader never sees half an export. */
+bool OxInstIPSMetricsExporter::writeFile(const std::string &text)
+{
+    std::string temporary = fileName_ + ".tmp";
+    FILE *fp = fopen(temporary.c_str(), "w");
+
+    if (fp == NULL) return false;
+    bool ok = fwrite(text.data(), 1, text.size(), fp) == text.size();
+    if (fclose(fp) != 0) ok = false;
+#ifdef _WIN32
+    if (ok) remove(fileName_.c_str());
+#endif
+    if (ok && rename(temporary.c_str(), fileName_.c_str()) != 0) ok = false;
+    return ok;
+}
+
+void OxInstIPSMetricsExporter::exportTask()
+{
+    bool failed = false;
+
+    for (;;) {
+        std::string text;
+        collect(text);
+        if (!fileName_.empty()) {
+            bool ok = writeFile(text);
+            if (!ok && !failed) printf("%s: cannot write %s\n", exporterName, fileName_.c_str());
+            failed = !ok;
+        } else {
+            mutex_.lock();
+            text_.swap(text);
+            mutex_.unlock();
+        }
+        epicsThreadSleep(interval_);
+    }
+}
+
+void OxInstIPSMetricsExporter::serveTask()
+{
+#ifndef _WIN32
+    for (;;) {
+        int fd = accept(listenFd_, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) epicsThreadSleep(1.0);
+            continue;
+        }
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        mutex_.lock();
+        std::string text = text_;
+        mutex_.unlock();
+        for (size_t sent = 0; sent < text.size(); ) {
+            ssize_t n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += (size_t)n;
+        }
+        close(fd);
+    }
+#endif
+}
+
+/* Configuration routine.  Called directly, or from the iocsh function below. */
+extern "C" {
+
+int OxInstIPSMetricsConfig(const char *target, int intervalMs)
+{
+    if (target == NULL || target[0] == '\0') {
+        printf("%s: no target file or socket given\n", exporterName);
+        return -1;
+    }
+    if (intervalMs <= 0) intervalMs = 10000;
+    OxInstIPSMetricsExporter *exporter = new OxInstIPSMetricsExporter(target, intervalMs / 1000.0);
+    return exporter->start() ? 0 : -1;
+}
+
+static const iocshArg metricsArg0 = { "target", iocshArgString };
+static const iocshArg metricsArg1 = { "intervalMs", iocshArgInt };
+static const iocshArg * const metricsArgs[] = { &metricsArg0, &metricsArg1 };
+static const iocshFuncDef metricsFuncDef = { "OxInstIPSMetricsConfig", 2, metricsArgs };
+
+static void metricsCallFunc(const iocshArgBuf *args)
+{
+    OxInstIPSMetricsConfig(args[0].sval, args[1].ival);
+}
+
+void OxInstIPSMetricsRegister(void)
+{
+    iocshRegister(&metricsFuncDef, metricsCallFunc);
+}
+
+epicsExportRegistrar(OxInstIPSMetricsRegister);
+
+}
@@ -0,0 +1,74 @@
+/* OxInstIPSMetrics.h
+ *
+ * Driver performance counters, and their export in OpenMetrics text format for
+ * monitoring systems that scrape text rather than PVs.
+ *
+ * Configure from the IOC shell with
+ *   OxInstIPSMetricsConfig(target, intervalMs)
+ * where target is a file, rewritten every interval (e.g. for the node_exporter textfile
+ * collector), or unix:<path> for a Unix socket that serves the latest text to each
+ * connection.  Every OxInstIPS port in the IOC is exported, labelled with its name.
+ */
+#ifndef OxInstIPSMetrics_H
+#define OxInstIPSMetrics_H
+
+#include <string>
+#include <vector>
+
+#include "epicsMutex.h"
+#include "epicsTypes.h"
+
+/* Round trip time histogram buckets, upper bounds in seconds, plus +Inf. */
+#define OXINSTIPS_RTT_BUCKETS 8
+
+/* Transaction counters.  Updated by whichever thread does the I/O. */
+class OxInstIPSCounters {
+public:
+    enum Outcome {
+        OutcomeOk,
+        OutcomeTimeout,
+        OutcomeError,               /* asyn error other than a timeout */
+        OutcomeRejected,            /* the IPS answered '?' */
+        NumOutcomes
+    };
+
+    struct Values {
+        epicsUInt64 outcomes[NumOutcomes];
+        epicsUInt64 parseErrors;
+        epicsUInt64 rtt[OXINSTIPS_RTT_BUCKETS + 1];     /* not cumulative */
+        double rttSum;              /* s */
+        double busy;                /* s the port was in use, including the command gap */
+    };
+
+    static const double rttBounds[OXINSTIPS_RTT_BUCKETS];
+    static const char *outcomeName(Outcome outcome);
+
+    OxInstIPSCounters();
+    void addTransaction(Outcome outcome, double rtt, double busy);
+    void addParseError();
+    Values values() const;
+
+private:
+    mutable epicsMutex mutex_;
+    Values values_;
+};
+
+/* Everything exported for one unit. */
+struct OxInstIPSMetricsSample {
+    std::string port;
+    OxInstIPSCounters::Values counters;
+    epicsUInt32 pollCycles;
+    epicsUInt32 pollOverruns;
+    epicsUInt32 pollMisses;
+    int deferred;                   /* reads left over from the last poll cycle */
+    int waiters;
+    int shed;
+    int stale;
+    int alive;
+    double utilisation;             /* busy fraction since the previous export */
+};
+
+/* Appends samples as an OpenMetrics exposition, terminated by # EOF. */
+void OxInstIPSFormatMetrics(const std::vector<OxInstIPSMetricsSample> &samples, std::string &text);
+
+#endif /* OxInstIPSMetrics_H */
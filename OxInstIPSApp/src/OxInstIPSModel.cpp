@@ -0,0 +1,36 @@
+/* OxInstIPSModel.cpp
+ *
+ * The IPS models known to OxInstIPSModelConfig.  See OxInstIPSModel.h.
+ */
+#include <stddef.h>
+#include <string.h>
+
+#include "OxInstIPSModel.h"
+
+/* The generic entry first.  The IPS120-20 gives the same current at 20 V. */
+static const OxInstIPSModelInfo models[] = {
+    { "generic",        OXINSTIPS_READ_ALL, 1, 0.0,   4, 5, 3, 4 },
+    { "IPS120-10",      OXINSTIPS_READ_ALL, 1, 120.0, 4, 5, 3, 4 },
+    { "IPS120-20",      OXINSTIPS_READ_ALL, 1, 120.0, 4, 5, 3, 4 },
+    { "IPS120-10x2",    OXINSTIPS_READ_ALL, 2, 240.0, 4, 5, 3, 4 },
+    { "IPS120-20x2",    OXINSTIPS_READ_ALL, 2, 240.0, 4, 5, 3, 4 }
+};
+#define NUM_MODELS (sizeof(models) / sizeof(models[0]))
+
+const OxInstIPSModelInfo *OxInstIPSFindModel(const char *name)
+{
+    for (size_t i = 0; name && i < NUM_MODELS; i++) {
+        if (strcmp(name, models[i].name) == 0) return &models[i];
+    }
+    return NULL;
+}
+
+const OxInstIPSModelInfo &OxInstIPSGenericModel()
+{
+    return models[0];
+}
+
+const char *OxInstIPSModelName(size_t i)
+{
+    return i < NUM_MODELS ? models[i].name : NULL;
+}
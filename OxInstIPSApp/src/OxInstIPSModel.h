@@ -0,0 +1,40 @@
+/* OxInstIPSModel.h
+ *
+ * The fixed properties of each IPS variant: the R parameters it has, the resolution of
+ * its set commands, its maximum current and how many units are chained to make it.
+ * The driver holds a copy of its model's entry and checks it at run time.
+ *
+ * Configure from the IOC shell with
+ *   OxInstIPSModelConfig(portName, serialPort, model, pollPeriodMs, commandGapMs)
+ * where model is one of the names listed by OxInstIPSModelConfig with no arguments.
+ */
+#ifndef OxInstIPSModel_H
+#define OxInstIPSModel_H
+
+#include <stddef.h>
+
+#include "epicsTypes.h"
+
+#include "OxInstIPSCapability.h"
+
+struct OxInstIPSModelInfo {
+    const char *name;
+    epicsUInt32 readMask;           /* OXINSTIPS_READ bits of the R parameters it has */
+    int units;                      /* units in parallel, controlled through the first */
+    double maxCurrent;              /* A for the whole supply, 0 for no limit */
+    int currentDecimals;            /* of I, J, S and T at extended resolution */
+    int fieldDecimals;
+    int currentRateDecimals;
+    int fieldRateDecimals;
+};
+
+/* The model called name, or NULL if there is none. */
+const OxInstIPSModelInfo *OxInstIPSFindModel(const char *name);
+
+/* Any IPS, as the StreamDevice protocol treats it.  Used by OxInstIPSConfig. */
+const OxInstIPSModelInfo &OxInstIPSGenericModel();
+
+/* Name of the i-th model, or NULL past the last. */
+const char *OxInstIPSModelName(size_t i);
+
+#endif /* OxInstIPSModel_H */
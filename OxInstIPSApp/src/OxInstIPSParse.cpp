@@ -0,0 +1,221 @@
+/* OxInstIPSParse.cpp
+ *
+ * Conversion of the numbers in R command replies.  See OxInstIPSParse.h.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "epicsEndian.h"
+#include "epicsStdio.h"
+#include "epicsTime.h"
+#include "epicsTypes.h"
+#include "iocsh.h"
+
+#include "OxInstIPSUnitTable.h"
+#include "OxInstIPSParse.h"
+
+#include "epicsExport.h"
+
+/* Width of the digit field, and the most significant digits kept in it so that the
+ * mantissa is below 2^53 and exact as a double. */
+#define OXINSTIPS_PARSE_WIDTH  16
+#define OXINSTIPS_PARSE_DIGITS 15
+/* Lines scanned before they are converted, in OxInstIPSParseBatch. */
+#define OXINSTIPS_PARSE_CHUNK  64
+
+/* Powers of ten that are exact as doubles.  Dividing an exact mantissa by one of them
+ * rounds once, so gives the correctly rounded value, as strtod does. */
+static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#define OXINSTIPS_PARSE_MAX_SCALE ((int)(sizeof(powersOfTen) / sizeof(powersOfTen[0])) - 1)
+
+/* A number scanned into the digit field, right aligned and padded with '0'. */
+struct Scanned {
+    char digits[OXINSTIPS_PARSE_WIDTH];
+    int scale;                      /* digits after the point */
+    bool negative;
+    bool fallback;                  /* not a plain decimal - use strtod */
+};
+
+static void scan(const char *text, Scanned *scanned)
+{
+    const char *p = text;
+    char digits[OXINSTIPS_PARSE_DIGITS];
+    size_t count = 0, seen = 0;
+    int scale = 0;
+    bool point = false;
+
+    scanned->negative = false;
+    scanned->fallback = true;
+    if (*p == '+' || *p == '-') scanned->negative = (*p++ == '-');
+    for (;; p++) {
+        if (*p >= '0' && *p <= '9') {
+            seen++;
+            if (point) scale++;
+            if (count == 0 && *p == '0') continue;
+            if (count == OXINSTIPS_PARSE_DIGITS) return;
+            digits[count++] = *p;
+        } else if (*p == '.' && !point) {
+            point = true;
+        } else {
+            break;
+        }
+    }
+    /* Exponents and hex are left to strtod, as is no number at all. */
+    if (seen == 0 || scale > OXINSTIPS_PARSE_MAX_SCALE) return;
+    if (*p == 'e' || *p == 'E' || *p == 'x' || *p == 'X') return;
+    memset(scanned->digits, '0', OXINSTIPS_PARSE_WIDTH - count);
+    memcpy(scanned->digits + OXINSTIPS_PARSE_WIDTH - count, digits, count);
+    scanned->scale = scale;
+    scanned->fallback = false;
+}
+
+/* Value of eight ASCII digits, most significant first.  On a little endian machine the
+ * first digit is the low byte of the word: the low nibbles are the digit values, and
+ * three multiplies combine adjacent digits, then pairs, then fours. */
+static inline epicsUInt64 eightDigits(const char *chars)
+{
+#if EPICS_BYTE_ORDER == EPICS_ENDIAN_LITTLE
+    epicsUInt64 word;
+    memcpy(&word, chars, sizeof(word));
+    word = ((word & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+    word = ((word & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+    return ((word & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+#else
+    epicsUInt64 value = 0;
+    for (size_t i = 0; i < 8; i++) value = value * 10 + (chars[i] - '0');
+    return value;
+#endif
+}
+
+static inline double convert(const Scanned &scanned)
+{
+    epicsUInt64 mantissa = eightDigits(scanned.digits) * 100000000u + eightDigits(scanned.digits + 8);
+    double value = (double)mantissa / powersOfTen[scanned.scale];
+    return scanned.negative ? -value : value;
+}
+
+static bool parseScalar(const char *text, double *value)
+{
+    char *end;
+    double result = strtod(text, &end);
+
+    if (end == text) return false;
+    *value = result;
+    return true;
+}
+
+bool OxInstIPSParseNumber(const char *text, double *value)
+{
+    Scanned scanned;
+
+    scan(text, &scanned);
+    if (scanned.fallback) return parseScalar(text, value);
+    *value = convert(scanned);
+    return true;
+}
+
+size_t OxInstIPSParseBatch(const char *const *lines, size_t count, double *values, bool *ok)
+{
+    Scanned scanned[OXINSTIPS_PARSE_CHUNK];
+    size_t parsed = 0;
+
+    for (size_t start = 0; start < count; start += OXINSTIPS_PARSE_CHUNK) {
+        size_t n = count - start < OXINSTIPS_PARSE_CHUNK ? count - start : OXINSTIPS_PARSE_CHUNK;
+        for (size_t k = 0; k < n; k++) scan(lines[start + k], &scanned[k]);
+        for (size_t k = 0; k < n; k++) {
+            if (scanned[k].fallback) {
+                ok[start + k] = parseScalar(lines[start + k], &values[start + k]);
+            } else {
+                values[start + k] = convert(scanned[k]);
+                ok[start + k] = true;
+            }
+            if (ok[start + k]) parsed++;
+        }
+    }
+    return parsed;
+}
+
+/* Benchmark.  The check against strtod is testApp/OxInstIPSParseTest. */
+
+extern "C" {
+
+int OxInstIPSParseBenchmark(int units, int cycles)
+{
+    /* Formats of the R replies, by parameter. */
+    static const char *formats[] = { "%+.4f", "%+.3f", "%+.4f", "%.2f", "%+.5f" };
+    const size_t numFormats = sizeof(formats) / sizeof(formats[0]);
+    epicsTimeStamp t0, t1, t2;
+    epicsUInt32 seed = 12345;
+    double sum = 0.0;
+    int mismatches = 0;
+
+    if (units <= 0) units = 100;
+    if (cycles <= 0) cycles = 1000;
+    size_t count = (size_t)units * OXINSTIPS_UNIT_PARAMS;
+    std::vector<std::string> text(count);
+    std::vector<const char *> lines(count);
+    std::vector<double> scalar(count), batch(count);
+    std::vector<char> ok(count);
+    bool batchOk[OXINSTIPS_PARSE_CHUNK];
+
+    for (size_t i = 0; i < count; i++) {
+        char line[32];
+        seed = seed * 1664525u + 1013904223u;
+        epicsSnprintf(line, sizeof(line), formats[i % numFormats],
+                      ((seed >> 8) / (double)(1u << 24) - 0.5) * 200.0);
+        text[i] = line;
+        lines[i] = text[i].c_str();
+    }
+
+    epicsTimeGetCurrent(&t0);
+    for (int c = 0; c < cycles; c++) {
+        for (size_t i = 0; i < count; i++) ok[i] = parseScalar(lines[i], &scalar[i]);
+        sum += scalar[c % count];
+    }
+    epicsTimeGetCurrent(&t1);
+    for (int c = 0; c < cycles; c++) {
+        for (size_t i = 0; i < count; i += OXINSTIPS_PARSE_CHUNK) {
+            size_t n = count - i < OXINSTIPS_PARSE_CHUNK ? count - i : OXINSTIPS_PARSE_CHUNK;
+            OxInstIPSParseBatch(&lines[i], n, &batch[i], batchOk);
+        }
+        sum += batch[c % count];
+    }
+    epicsTimeGetCurrent(&t2);
+    for (size_t i = 0; i < count; i++) {
+        if (!ok[i] || memcmp(&scalar[i], &batch[i], sizeof(double)) != 0) mismatches++;
+    }
+
+    double scalarTime = epicsTimeDiffInSeconds(&t1, &t0) / cycles / count * 1e9;
+    double batchTime = epicsTimeDiffInSeconds(&t2, &t1) / cycles / count * 1e9;
+    printf("OxInstIPSParseBenchmark: %d units, %lu replies per cycle, %d cycles (check %g)\n",
+           units, (unsigned long)count, cycles, sum);
+    printf("  strtod %.1f ns/reply, batch %.1f ns/reply, %.2fx, %d mismatches\n",
+           scalarTime, batchTime, batchTime > 0.0 ? scalarTime / batchTime : 0.0, mismatches);
+    return mismatches;
+}
+
+static const iocshArg benchmarkArg0 = { "units", iocshArgInt };
+static const iocshArg benchmarkArg1 = { "cycles", iocshArgInt };
+static const iocshArg * const benchmarkArgs[] = { &benchmarkArg0, &benchmarkArg1 };
+static const iocshFuncDef benchmarkFuncDef = { "OxInstIPSParseBenchmark", 2, benchmarkArgs };
+
+static void benchmarkCallFunc(const iocshArgBuf *args)
+{
+    OxInstIPSParseBenchmark(args[0].ival, args[1].ival);
+}
+
+void OxInstIPSParseRegister(void)
+{
+    iocshRegister(&benchmarkFuncDef, benchmarkCallFunc);
+}
+
+epicsExportRegistrar(OxInstIPSParseRegister);
+
+}
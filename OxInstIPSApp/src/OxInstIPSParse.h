@@ -0,0 +1,25 @@
+/* OxInstIPSParse.h
+ *
+ * Conversion of the numbers in R command replies.  The replies are short fixed point
+ * decimals such as +12.3456, so the digits are gathered into a 16 byte field and
+ * converted eight at a time with integer arithmetic on a 64 bit word, and the value is
+ * then one exact division by a power of ten.  Anything else - exponents, hex, inf, nan,
+ * leading spaces, more than 15 significant digits - falls back to strtod.  Either way the
+ * result is what strtod returns.
+ *
+ * Checked against strtod by testApp/OxInstIPSParseTest and timed with
+ *   OxInstIPSParseBenchmark(units, cycles)
+ */
+#ifndef OxInstIPSParse_H
+#define OxInstIPSParse_H
+
+#include <stddef.h>
+
+/* Parses the number at the start of text as strtod does.  Returns false if there is none. */
+bool OxInstIPSParseNumber(const char *text, double *value);
+
+/* Parses count lines into values, setting ok[i] as OxInstIPSParseNumber would return.
+ * The lines are scanned first and then converted together.  Returns the number parsed. */
+size_t OxInstIPSParseBatch(const char *const *lines, size_t count, double *values, bool *ok);
+
+#endif /* OxInstIPSParse_H */
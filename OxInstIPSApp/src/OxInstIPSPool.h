@@ -0,0 +1,78 @@
+/* OxInstIPSPool.h
+ *
+ * A fixed-capacity pool of objects for the command path of one port.  The objects are
+ * built with the pool and handed out from a free list, so taking and returning one uses
+ * no heap.  If the pool runs dry an object is allocated from the heap and counted, and
+ * deleted when it is returned; a non-zero count means the capacity is too small.
+ */
+#ifndef OxInstIPSPool_H
+#define OxInstIPSPool_H
+
+#include <stddef.h>
+
+#include "epicsMutex.h"
+
+struct OxInstIPSPoolCounts {
+    size_t allocations;             /* objects taken, ever */
+    size_t heapAllocations;         /* of which from the heap */
+    size_t inUse;
+    size_t peak;                    /* most in use at once */
+};
+
+template <class T, size_t N>
+class OxInstIPSPool {
+public:
+    OxInstIPSPool() : freeCount_(N)
+    {
+        for (size_t i = 0; i < N; i++) free_[i] = &items_[N - 1 - i];
+        counts_.allocations = counts_.heapAllocations = counts_.inUse = counts_.peak = 0;
+    }
+
+    T *allocate()
+    {
+        T *item = NULL;
+
+        mutex_.lock();
+        counts_.allocations++;
+        if (freeCount_ > 0) item = free_[--freeCount_];
+        else counts_.heapAllocations++;
+        if (++counts_.inUse > counts_.peak) counts_.peak = counts_.inUse;
+        mutex_.unlock();
+        return item ? item : new T();
+    }
+
+    void release(T *item)
+    {
+        bool owned = false;
+
+        if (item == NULL) return;
+        for (size_t i = 0; i < N && !owned; i++) owned = (item == &items_[i]);
+        mutex_.lock();
+        counts_.inUse--;
+        if (owned) free_[freeCount_++] = item;
+        mutex_.unlock();
+        if (!owned) delete item;
+    }
+
+    size_t capacity() const { return N; }
+
+    OxInstIPSPoolCounts counts() const
+    {
+        mutex_.lock();
+        OxInstIPSPoolCounts counts = counts_;
+        mutex_.unlock();
+        return counts;
+    }
+
+private:
+    OxInstIPSPool(const OxInstIPSPool &);
+    OxInstIPSPool &operator=(const OxInstIPSPool &);
+
+    mutable epicsMutex mutex_;
+    T items_[N];
+    T *free_[N];
+    size_t freeCount_;
+    OxInstIPSPoolCounts counts_;
+};
+
+#endif /* OxInstIPSPool_H */
@@ -0,0 +1,81 @@
+/* OxInstIPSSequence.cpp
+ *
+ * The steps of each multi-step operation.  See OxInstIPSSequence.h.  Every sequence
+ * starts by holding the sweep (A0) so that it begins from a known state.
+ */
+#include <stddef.h>
+
+#include "OxInstIPSSequence.h"
+
+/* Put the magnet into persistent mode at the present field: close the switch, then run
+ * the leads down to zero. */
+static const OxInstIPSStep enterPersistent[] = {
+    { OxInstIPSStepSend,            "A0" },
+    { OxInstIPSStepWaitAtRest,      NULL },
+    { OxInstIPSStepSend,            "H0" },
+    { OxInstIPSStepWaitHeaterOff,   NULL },
+    { OxInstIPSStepSend,            "A2" },
+    { OxInstIPSStepWaitAtRest,      NULL },
+    { OxInstIPSStepEnd,             NULL }
+};
+
+/* Bring the leads back up to the persistent field before opening the switch. */
+static const OxInstIPSStep leavePersistent[] = {
+    { OxInstIPSStepSend,            "A0" },
+    { OxInstIPSStepMatchPersistent, NULL },
+    { OxInstIPSStepSend,            "A1" },
+    { OxInstIPSStepWaitAtRest,      NULL },
+    { OxInstIPSStepSend,            "H1" },
+    { OxInstIPSStepWaitHeaterOn,    NULL },
+    { OxInstIPSStepEnd,             NULL }
+};
+
+static const OxInstIPSStep heaterOn[] = {
+    { OxInstIPSStepSend,            "A0" },
+    { OxInstIPSStepWaitAtRest,      NULL },
+    { OxInstIPSStepSend,            "H1" },
+    { OxInstIPSStepWaitHeaterOn,    NULL },
+    { OxInstIPSStepEnd,             NULL }
+};
+
+static const OxInstIPSStep heaterOff[] = {
+    { OxInstIPSStepSend,            "A0" },
+    { OxInstIPSStepWaitAtRest,      NULL },
+    { OxInstIPSStepSend,            "H0" },
+    { OxInstIPSStepWaitHeaterOff,   NULL },
+    { OxInstIPSStepEnd,             NULL }
+};
+
+/* Hold, change the rate and go on to the target, from wherever the sweep was. */
+static const OxInstIPSStep ramp[] = {
+    { OxInstIPSStepSend,            "A0" },
+    { OxInstIPSStepSendRate,        NULL },
+    { OxInstIPSStepSendTarget,      NULL },
+    { OxInstIPSStepSend,            "A1" },
+    { OxInstIPSStepWaitAtRest,      NULL },
+    { OxInstIPSStepEnd,             NULL }
+};
+
+static const struct {
+    const char *name;
+    const OxInstIPSStep *steps;
+} sequences[OxInstIPSNumSequences] = {
+    { "none",               NULL },
+    { "enter persistent",   enterPersistent },
+    { "leave persistent",   leavePersistent },
+    { "heater on",          heaterOn },
+    { "heater off",         heaterOff },
+    { "ramp",               ramp }
+};
+
+const OxInstIPSStep *OxInstIPSSequenceSteps(int id)
+{
+    if (id < 0 || id >= OxInstIPSNumSequences) return NULL;
+    return sequences[id].steps;
+}
+
+const char *OxInstIPSSequenceName(int id)
+{
+    if (id < 0 || id >= OxInstIPSNumSequences) return "unknown";
+    return sequences[id].name;
+}
@@ -0,0 +1,60 @@
+/* OxInstIPSSequence.h
+ *
+ * Multi-step operations - persistent mode entry and exit, heater switching, a ramp
+ * with a new sweep rate - written as tables of steps.  The driver runs at most one
+ * sequence per unit on its poll thread: each cycle it sends commands until it reaches a
+ * wait, and resumes from that wait on a later cycle once the X status shows it is over.
+ * A waiting sequence holds no thread and never sleeps, so any number of units can run
+ * sequences at once.
+ */
+#ifndef OxInstIPSSequence_H
+#define OxInstIPSSequence_H
+
+/* Values written to SEQ_START. */
+enum OxInstIPSSequenceId {
+    OxInstIPSSequenceNone,
+    OxInstIPSSequenceEnterPersistent,
+    OxInstIPSSequenceLeavePersistent,
+    OxInstIPSSequenceHeaterOn,
+    OxInstIPSSequenceHeaterOff,
+    OxInstIPSSequenceRamp,
+    OxInstIPSNumSequences
+};
+
+/* Values of SEQ_STATE. */
+enum OxInstIPSSequenceState {
+    OxInstIPSSequenceIdle,
+    OxInstIPSSequenceRunning,
+    OxInstIPSSequenceDone,
+    OxInstIPSSequenceFailed,
+    OxInstIPSSequenceAborted
+};
+
+enum OxInstIPSStepOp {
+    OxInstIPSStepSend,              /* send command */
+    OxInstIPSStepSendRate,          /* send T with SEQ_RATE, if it is not 0 */
+    OxInstIPSStepSendTarget,        /* send J with SEQ_TARGET */
+    OxInstIPSStepMatchPersistent,   /* read the persistent field (R18) and send J with it */
+    OxInstIPSStepWaitAtRest,        /* sweep at rest, within MOVE_TIMEOUT */
+    OxInstIPSStepWaitHeaterOn,      /* switch heater on for SEQ_HEATER_TIME */
+    OxInstIPSStepWaitHeaterOff,     /* switch heater off for SEQ_HEATER_TIME */
+    OxInstIPSStepEnd
+};
+
+struct OxInstIPSStep {
+    OxInstIPSStepOp op;
+    const char *command;
+};
+
+/* Switch heater, the H n digit of the X reply. */
+#define OXINSTIPS_HEATER_OFF_AT_ZERO 0
+#define OXINSTIPS_HEATER_ON          1
+#define OXINSTIPS_HEATER_OFF_AT_FIELD 2
+#define OXINSTIPS_HEATER_FAULT       5
+#define OXINSTIPS_HEATER_NO_SWITCH   8
+
+/* Steps of a sequence, ending with OxInstIPSStepEnd, or NULL for an unknown id. */
+const OxInstIPSStep *OxInstIPSSequenceSteps(int id);
+const char *OxInstIPSSequenceName(int id);
+
+#endif /* OxInstIPSSequence_H */
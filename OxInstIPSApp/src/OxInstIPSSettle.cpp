@@ -0,0 +1,129 @@
+/* OxInstIPSSettle.cpp
+ *
+ * Settle detection for the IPS from rolling statistics of R2 and R7.
+ *
+ * The field is considered settled when, over the whole window:
+ *   - the X status has reported the sweep "At rest" for every sample,
+ *   - the standard deviation of the measured current is within the current tolerance,
+ *   - the mean measured current is within the current tolerance of the demand current,
+ *   - the standard deviation of the demand field is within the field tolerance.
+ */
+#include <math.h>
+
+#include "OxInstIPSSettle.h"
+
+void OxInstIPSSettle::Channel::reset(size_t window)
+{
+    samples.assign(window, 0.0);
+    offset = 0.0;
+    sum = 0.0;
+    sumSquares = 0.0;
+}
+
+/* The sums are of the samples less offset, a value near the window mean, so that the
+ * running sum of squares does not lose the noise to cancellation at high currents. */
+void OxInstIPSSettle::Channel::replace(size_t slot, double value, bool full)
+{
+    if (full) {
+        double old = samples[slot] - offset;
+        sum -= old;
+        sumSquares -= old * old;
+    }
+    samples[slot] = value;
+    double shifted = value - offset;
+    sum += shifted;
+    sumSquares += shifted * shifted;
+}
+
+/* Moves offset to the mean of the first count slots and sums them again, dropping the
+ * rounding error of the running updates and recentring them after a sweep. */
+void OxInstIPSSettle::Channel::resum(size_t count)
+{
+    if (count == 0) return;
+    offset = mean(count);
+    sum = 0.0;
+    sumSquares = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double shifted = samples[i] - offset;
+        sum += shifted;
+        sumSquares += shifted * shifted;
+    }
+}
+
+double OxInstIPSSettle::Channel::mean(size_t count) const
+{
+    return count ? offset + sum / count : 0.0;
+}
+
+double OxInstIPSSettle::Channel::stddev(size_t count) const
+{
+    if (count < 2) return 0.0;
+    double variance = (sumSquares - sum * sum / count) / (count - 1);
+    return variance > 0.0 ? sqrt(variance) : 0.0;
+}
+
+OxInstIPSSettle::OxInstIPSSettle(size_t window)
+    : window_(window ? window : 1), head_(0), count_(0), restCount_(0),
+      currentTolerance_(0.0), fieldTolerance_(0.0), lastDemandCurrent_(0.0)
+{
+    reset();
+}
+
+void OxInstIPSSettle::setWindow(size_t window)
+{
+    window_ = window ? window : 1;
+    reset();
+}
+
+void OxInstIPSSettle::setTolerances(double currentTolerance, double fieldTolerance)
+{
+    currentTolerance_ = fabs(currentTolerance);
+    fieldTolerance_ = fabs(fieldTolerance);
+}
+
+void OxInstIPSSettle::reset()
+{
+    head_ = 0;
+    count_ = 0;
+    restCount_ = 0;
+    current_.reset(window_);
+    field_.reset(window_);
+}
+
+void OxInstIPSSettle::addSample(double measuredCurrent, double demandCurrent, double demandField, bool atRest)
+{
+    if (count_ == 0) {
+        current_.offset = measuredCurrent;
+        field_.offset = demandField;
+    }
+    bool full = (count_ == window_);
+    current_.replace(head_, measuredCurrent, full);
+    field_.replace(head_, demandField, full);
+    head_ = (head_ + 1) % window_;
+    if (!full) count_++;
+    if (head_ == 0) {
+        current_.resum(count_);
+        field_.resum(count_);
+    }
+
+    restCount_ = atRest ? restCount_ + 1 : 0;
+    lastDemandCurrent_ = demandCurrent;
+}
+
+bool OxInstIPSSettle::isSettled() const
+{
+    if (count_ < window_ || restCount_ < window_) return false;
+    if (current_.stddev(count_) > currentTolerance_) return false;
+    if (fabs(current_.mean(count_) - lastDemandCurrent_) > currentTolerance_) return false;
+    return field_.stddev(count_) <= fieldTolerance_;
+}
+
+double OxInstIPSSettle::currentNoise() const
+{
+    return current_.stddev(count_);
+}
+
+double OxInstIPSSettle::fieldNoise() const
+{
+    return field_.stddev(count_);
+}
@@ -0,0 +1,57 @@
+/* OxInstIPSSettle.h
+ *
+ * Rolling statistics of the measured magnet current (R2) and demand field (R7)
+ * used to decide when the field has settled after a sweep.  Each sample is
+ * added in constant time; the window is a pair of ring buffers with running
+ * sums, so the cost does not depend on the window length.  The sums are
+ * recomputed from the buffers once per pass round the ring, which is still
+ * constant time per sample.
+ */
+#ifndef OxInstIPSSettle_H
+#define OxInstIPSSettle_H
+
+#include <stddef.h>
+#include <vector>
+
+class OxInstIPSSettle {
+public:
+    explicit OxInstIPSSettle(size_t window);
+
+    /* Changing the window length discards the samples collected so far. */
+    void setWindow(size_t window);
+    void setTolerances(double currentTolerance, double fieldTolerance);
+    void reset();
+
+    /* atRest is true when the X status reports the sweep as "At rest". */
+    void addSample(double measuredCurrent, double demandCurrent, double demandField, bool atRest);
+
+    bool isSettled() const;
+    double currentNoise() const;
+    double fieldNoise() const;
+    size_t window() const { return window_; }
+
+private:
+    struct Channel {
+        std::vector<double> samples;
+        double offset;
+        double sum;
+        double sumSquares;
+        void reset(size_t window);
+        void replace(size_t slot, double value, bool full);
+        void resum(size_t count);
+        double mean(size_t count) const;
+        double stddev(size_t count) const;
+    };
+
+    size_t window_;
+    size_t head_;
+    size_t count_;
+    size_t restCount_;
+    double currentTolerance_;
+    double fieldTolerance_;
+    double lastDemandCurrent_;
+    Channel current_;
+    Channel field_;
+};
+
+#endif /* OxInstIPSSettle_H */
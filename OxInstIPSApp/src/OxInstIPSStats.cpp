@@ -0,0 +1,102 @@
+/* OxInstIPSStats.cpp
+ *
+ * Rolling statistics of one read parameter.  See OxInstIPSStats.h.
+ */
+#include <math.h>
+
+#include "OxInstIPSStats.h"
+
+/* Running sums are recomputed this often to stop rounding errors building up. */
+#define OXINSTIPS_STATS_RESUM 10000
+
+OxInstIPSStats::OxInstIPSStats(double window)
+    : window_(window > 0.0 ? window : 0.0)
+{
+    reset();
+}
+
+void OxInstIPSStats::setWindow(double seconds)
+{
+    window_ = seconds > 0.0 ? seconds : 0.0;
+}
+
+void OxInstIPSStats::reset()
+{
+    samples_.clear();
+    minQueue_.clear();
+    maxQueue_.clear();
+    offset_ = 0.0;
+    sum_ = 0.0;
+    sumSquares_ = 0.0;
+    sinceResum_ = 0;
+}
+
+/* As in OxInstIPSSettle, sums are of values relative to an offset so that the sum of
+ * squares keeps the spread of a large value. */
+void OxInstIPSStats::resum()
+{
+    offset_ = samples_.empty() ? 0.0 : samples_.front().value;
+    sum_ = 0.0;
+    sumSquares_ = 0.0;
+    for (std::deque<Sample>::const_iterator it = samples_.begin(); it != samples_.end(); ++it) {
+        double shifted = it->value - offset_;
+        sum_ += shifted;
+        sumSquares_ += shifted * shifted;
+    }
+    sinceResum_ = 0;
+}
+
+void OxInstIPSStats::addSample(const epicsTimeStamp &time, double value)
+{
+    Sample sample;
+
+    sample.time = time.secPastEpoch + time.nsec * 1e-9;
+    sample.value = value;
+    if (samples_.empty()) offset_ = value;
+
+    /* A window of 0 keeps just the latest sample. */
+    double cutoff = sample.time - window_;
+    while (!samples_.empty() && (samples_.front().time <= cutoff || window_ == 0.0)) {
+        double shifted = samples_.front().value - offset_;
+        sum_ -= shifted;
+        sumSquares_ -= shifted * shifted;
+        samples_.pop_front();
+    }
+    while (!minQueue_.empty() && (minQueue_.front().time <= cutoff || window_ == 0.0)) minQueue_.pop_front();
+    while (!maxQueue_.empty() && (maxQueue_.front().time <= cutoff || window_ == 0.0)) maxQueue_.pop_front();
+
+    samples_.push_back(sample);
+    double shifted = value - offset_;
+    sum_ += shifted;
+    sumSquares_ += shifted * shifted;
+    while (!minQueue_.empty() && minQueue_.back().value >= value) minQueue_.pop_back();
+    minQueue_.push_back(sample);
+    while (!maxQueue_.empty() && maxQueue_.back().value <= value) maxQueue_.pop_back();
+    maxQueue_.push_back(sample);
+
+    if (++sinceResum_ >= OXINSTIPS_STATS_RESUM || samples_.size() == 1) resum();
+}
+
+double OxInstIPSStats::min() const
+{
+    return minQueue_.empty() ? 0.0 : minQueue_.front().value;
+}
+
+double OxInstIPSStats::max() const
+{
+    return maxQueue_.empty() ? 0.0 : maxQueue_.front().value;
+}
+
+double OxInstIPSStats::mean() const
+{
+    size_t n = samples_.size();
+    return n ? offset_ + sum_ / n : 0.0;
+}
+
+double OxInstIPSStats::stddev() const
+{
+    size_t n = samples_.size();
+    if (n < 2) return 0.0;
+    double variance = (sumSquares_ - sum_ * sum_ / n) / (n - 1);
+    return variance > 0.0 ? sqrt(variance) : 0.0;
+}
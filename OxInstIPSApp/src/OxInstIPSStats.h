@@ -0,0 +1,51 @@
+/* OxInstIPSStats.h
+ *
+ * Rolling statistics of one read parameter over the last few seconds: minimum,
+ * maximum, mean and standard deviation, so that peaks between archive samples are
+ * not lost.  Each sample is added in amortised constant time - the window is kept
+ * in time order with running sums, and the extremes in monotonic queues that each
+ * sample enters and leaves once.
+ */
+#ifndef OxInstIPSStats_H
+#define OxInstIPSStats_H
+
+#include <stddef.h>
+#include <deque>
+
+#include "epicsTime.h"
+
+class OxInstIPSStats {
+public:
+    explicit OxInstIPSStats(double window = 60.0);
+
+    /* Samples older than the new window are dropped on the next addSample(). */
+    void setWindow(double seconds);
+    void reset();
+
+    void addSample(const epicsTimeStamp &time, double value);
+
+    size_t count() const { return samples_.size(); }
+    double min() const;
+    double max() const;
+    double mean() const;
+    double stddev() const;
+
+private:
+    struct Sample {
+        double time;            /* s since the EPICS epoch */
+        double value;
+    };
+
+    void resum();
+
+    double window_;
+    std::deque<Sample> samples_;
+    std::deque<Sample> minQueue_;   /* increasing values, the window minimum at the front */
+    std::deque<Sample> maxQueue_;   /* decreasing values, the window maximum at the front */
+    double offset_;
+    double sum_;
+    double sumSquares_;
+    size_t sinceResum_;
+};
+
+#endif /* OxInstIPSStats_H */
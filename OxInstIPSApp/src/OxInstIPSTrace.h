@@ -0,0 +1,42 @@
+/* OxInstIPSTrace.h
+ *
+ * Static tracepoints in the driver's transaction path, provider "oxinstips":
+ *
+ *   enqueue(port, what)                 a read falls due, or a setpoint or settle wait is queued
+ *   send(port, command)                 command about to be written
+ *   reply(port, command, status, bytes) reply complete, or the transaction failed
+ *   parse(port, command, status)        reply parsed
+ *   publish(port, cycle)                poll cycle results about to be posted to records
+ *
+ * The probes are USDT probes, built in when OXINSTIPS_USDT = YES in configure/CONFIG
+ * (which needs <sys/sdt.h>, from systemtap-sdt-dev or systemtap-sdt-devel) and compiled
+ * out otherwise.  A built-in probe is a single nop until a tracer attaches to it, and its
+ * arguments are only values already at hand, so the tracer supplies the timestamps:
+ *
+ *   bpftrace -e 'usdt:lib/linux-x86_64/libOxInstIPSSupport.so:oxinstips:reply
+ *                { printf("%s %s %d\n", str(arg0), str(arg1), arg2); }'
+ *   perf probe -x lib/linux-x86_64/libOxInstIPSSupport.so sdt_oxinstips:send
+ *
+ * The first byte of a reply is not visible here, as the write and read are one asyn
+ * transaction; asyn's own traceIO on the serial port timestamps the bytes.
+ */
+#ifndef OxInstIPSTrace_H
+#define OxInstIPSTrace_H
+
+#ifdef OXINSTIPS_USDT
+
+#include <sys/sdt.h>
+
+#define OXINSTIPS_TRACE2(name, a, b)            DTRACE_PROBE2(oxinstips, name, a, b)
+#define OXINSTIPS_TRACE3(name, a, b, c)         DTRACE_PROBE3(oxinstips, name, a, b, c)
+#define OXINSTIPS_TRACE4(name, a, b, c, d)      DTRACE_PROBE4(oxinstips, name, a, b, c, d)
+
+#else
+
+#define OXINSTIPS_TRACE2(name, a, b)            do { } while (0)
+#define OXINSTIPS_TRACE3(name, a, b, c)         do { } while (0)
+#define OXINSTIPS_TRACE4(name, a, b, c, d)      do { } while (0)
+
+#endif /* OXINSTIPS_USDT */
+
+#endif /* OxInstIPSTrace_H */
@@ -0,0 +1,99 @@
+/* OxInstIPSUnitTable.h
+ *
+ * Live state of the read parameters of every IPS unit in the IOC, laid out as one
+ * column per parameter with a slot per unit - the demand current of all units is
+ * contiguous, and so on - so that passes over all units run down contiguous memory and
+ * vectorise.  Each driver owns one slot and updates it from its poll thread, and the
+ * overview pass reads every slot a column at a time.  Each column has its own lock, so
+ * a poll thread only waits for another working on the same column.
+ *
+ * The overview pass is timed against the same pass over one structure per unit with
+ *   OxInstIPSUnitBenchmark(maxUnits, cycles)
+ * and testApp/OxInstIPSUnitTableTest checks that both give the same results.
+ */
+#ifndef OxInstIPSUnitTable_H
+#define OxInstIPSUnitTable_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "epicsMutex.h"
+#include "epicsTime.h"
+
+#include "OxInstIPSCodec.h"
+
+/* Read parameters per unit, in the order of the driver's read parameters and the history. */
+#define OXINSTIPS_UNIT_PARAMS OXINSTIPS_HISTORY_VALUES
+
+/* Columns of the readbacks shown on overview displays. */
+#define OXINSTIPS_UNIT_DEMAND_CURRENT 0     /* R0 */
+#define OXINSTIPS_UNIT_DEMAND_FIELD 5       /* R7 */
+
+/* Column lock of the fault digits; the read parameters are 0 to OXINSTIPS_UNIT_PARAMS-1. */
+#define OXINSTIPS_UNIT_FAULT OXINSTIPS_UNIT_PARAMS
+
+class OxInstIPSUnitTable {
+public:
+    static OxInstIPSUnitTable &instance();
+
+    /* Adds a unit and returns its slot.  Column pointers are invalid afterwards. */
+    size_t addUnit(const std::string &port);
+
+    /* The table lock holds the number of units and the ports; a column lock holds the
+     * elements of one column.  The table lock is taken first when both are needed. */
+    void lock() { mutex_.lock(); }
+    void unlock() { mutex_.unlock(); }
+    void lockColumn(size_t param) { columnMutex_[param].lock(); }
+    void unlockColumn(size_t param) { columnMutex_[param].unlock(); }
+
+    /* Called with the table locked. */
+    size_t units() const { return ports_.size(); }
+    const std::string &port(size_t unit) const { return ports_[unit]; }
+
+    /* Called with the table locked: the overview of the first units slots.  Fills the
+     * demand current and field, NaN where the last read failed, the fault digit and the
+     * number of stale readbacks of each unit, taking each column lock in turn. */
+    void overview(size_t units, double *current, double *field, double *fault, double *stales);
+
+    /* Everything below is called with the column locked. */
+
+    /* Last good reading and when it last changed, in seconds since the EPICS epoch. */
+    double &value(size_t param, size_t unit) { return value_[param][unit]; }
+    double &changed(size_t param, size_t unit) { return changed_[param][unit]; }
+    /* Flags, 1.0 or 0.0: a reading has been seen, the latest read succeeded, stuck.  They
+     * are doubles so that a pass mixing them with values keeps one element width, which
+     * plain SSE2 needs to vectorise it. */
+    double &seen(size_t param, size_t unit) { return seen_[param][unit]; }
+    double &valid(size_t param, size_t unit) { return valid_[param][unit]; }
+    double &stale(size_t param, size_t unit) { return stale_[param][unit]; }
+    /* X m system fault digit of the last status read, -1 if it failed. */
+    double &fault(size_t unit) { return fault_[unit]; }
+
+    const double *values(size_t param) const { return value_[param].empty() ? NULL : &value_[param][0]; }
+    const double *valids(size_t param) const { return valid_[param].empty() ? NULL : &valid_[param][0]; }
+    const double *stales(size_t param) const { return stale_[param].empty() ? NULL : &stale_[param][0]; }
+    const double *faults() const { return fault_.empty() ? NULL : &fault_[0]; }
+
+    static double toSeconds(const epicsTimeStamp &time) { return time.secPastEpoch + time.nsec * 1e-9; }
+
+private:
+    OxInstIPSUnitTable() {}
+    friend struct BenchmarkRun;
+
+    epicsMutex mutex_;
+    epicsMutex columnMutex_[OXINSTIPS_UNIT_PARAMS + 1];
+    std::vector<std::string> ports_;
+    std::vector<double> value_[OXINSTIPS_UNIT_PARAMS];
+    std::vector<double> changed_[OXINSTIPS_UNIT_PARAMS];
+    std::vector<double> seen_[OXINSTIPS_UNIT_PARAMS];
+    std::vector<double> valid_[OXINSTIPS_UNIT_PARAMS];
+    std::vector<double> stale_[OXINSTIPS_UNIT_PARAMS];
+    std::vector<double> fault_;
+};
+
+/* Runs the overview pass over units in one structure per unit and in a unit table for
+ * cycles and returns whether both give the same results. */
+bool OxInstIPSUnitLayoutsAgree(size_t units, int cycles);
+
+#endif /* OxInstIPSUnitTable_H */
@@ -0,0 +1,251 @@
+/* OxInstIPSVector.cpp
+ *
+ * Coordinated control of a vector magnet driven by three IPS units.  See OxInstIPSVector.h.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "epicsThread.h"
+#include "iocsh.h"
+
+#include "OxInstIPSVector.h"
+
+#include "epicsExport.h"
+
+static const char *driverName = "OxInstIPSVector";
+
+/* Smallest sweep rate the T command can express (T%#.4f), in T/min. */
+#define OXINSTIPS_VECTOR_MIN_RATE 0.0001
+
+/* Axes whose change is below the J command resolution (J%#.5f) are not moved. */
+#define OXINSTIPS_VECTOR_MIN_CHANGE 0.00001
+
+static void monitorTaskC(void *drvPvt)
+{
+    OxInstIPSVector *pPvt = (OxInstIPSVector *)drvPvt;
+    pPvt->monitorTask();
+}
+
+OxInstIPSVector::OxInstIPSVector(const char *portName, const char *axisPorts[OXINSTIPS_VECTOR_AXES])
+    : asynPortDriver(portName, OXINSTIPS_VECTOR_AXES,
+                     asynInt32Mask | asynFloat64Mask | asynDrvUserMask,
+                     asynInt32Mask | asynFloat64Mask,
+                     ASYN_MULTIDEVICE, 1, 0, 0),
+      moveFailed_(false), completeEvent_(epicsEventMustCreate(epicsEventEmpty))
+{
+    static const char *functionName = "OxInstIPSVector";
+
+    createParam(P_VectorTargetXString,  asynParamFloat64, &P_VectorTargetX);
+    createParam(P_VectorTargetYString,  asynParamFloat64, &P_VectorTargetY);
+    createParam(P_VectorTargetZString,  asynParamFloat64, &P_VectorTargetZ);
+    createParam(P_VectorRateString,     asynParamFloat64, &P_VectorRate);
+    createParam(P_VectorGoString,       asynParamInt32,   &P_VectorGo);
+    createParam(P_VectorStateString,    asynParamInt32,   &P_VectorState);
+    createParam(P_VectorMoveTimeString, asynParamFloat64, &P_VectorMoveTime);
+    createParam(P_VectorAxisRateString, asynParamFloat64, &P_VectorAxisRate);
+
+    setIntegerParam(P_VectorState, OxInstIPSVectorIdle);
+    setDoubleParam(P_VectorMoveTime, 0.0);
+    for (int i = 0; i < OXINSTIPS_VECTOR_AXES; i++) {
+        setDoubleParam(i, P_VectorAxisRate, 0.0);
+    }
+
+    memset(waiters_, 0, sizeof(waiters_));
+    for (int i = 0; i < OXINSTIPS_VECTOR_AXES; i++) {
+        asynPortDriver *pDriver = static_cast<asynPortDriver *>(findAsynPortDriver(axisPorts[i]));
+        axes_[i] = dynamic_cast<OxInstIPSDriver *>(pDriver);
+        axisActive_[i] = false;
+        if (axes_[i] == NULL) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: %s is not an OxInstIPS port\n",
+                driverName, functionName, axisPorts[i] ? axisPorts[i] : "(null)");
+        }
+        waiters_[i].driver = axes_[i];
+        waiters_[i].condition = OxInstIPSWaitFieldTarget;
+        waiters_[i].complete = axisComplete;
+        waiters_[i].userPvt = this;
+    }
+
+    if (epicsThreadCreate("OxInstIPSVector",
+                          epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackSmall),
+                          (EPICSTHREADFUNC)monitorTaskC, this) == NULL) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: epicsThreadCreate failure\n", driverName, functionName);
+    }
+}
+
+/* Called from the axis poll thread with the axis driver locked, so must not lock this
+ * driver - startMove() locks this driver first and then the axis. */
+void OxInstIPSVector::axisComplete(OxInstIPSWaiter *waiter)
+{
+    OxInstIPSVector *pVector = static_cast<OxInstIPSVector *>(waiter->userPvt);
+    epicsEventSignal(pVector->completeEvent_);
+}
+
+/* Called with this driver locked. */
+asynStatus OxInstIPSVector::startMove()
+{
+    static const char *functionName = "startMove";
+    double target[OXINSTIPS_VECTOR_AXES], current[OXINSTIPS_VECTOR_AXES], change[OXINSTIPS_VECTOR_AXES];
+    double rate, distance = 0.0, minutes;
+    int state;
+    asynStatus status = asynSuccess;
+
+    getIntegerParam(P_VectorState, &state);
+    if (state == OxInstIPSVectorMoving) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: %s: move already in progress\n", driverName, functionName, portName);
+        return asynError;
+    }
+    getDoubleParam(P_VectorTargetX, &target[0]);
+    getDoubleParam(P_VectorTargetY, &target[1]);
+    getDoubleParam(P_VectorTargetZ, &target[2]);
+    getDoubleParam(P_VectorRate, &rate);
+    if (rate <= 0.0) return asynError;
+
+    for (int i = 0; i < OXINSTIPS_VECTOR_AXES; i++) {
+        if (axes_[i] == NULL || axes_[i]->getDemandField(&current[i]) != asynSuccess) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: %s: no demand field for axis %d\n", driverName, functionName, portName, i);
+            setIntegerParam(P_VectorState, OxInstIPSVectorFailed);
+            return asynError;
+        }
+        change[i] = target[i] - current[i];
+        distance += change[i] * change[i];
+    }
+    distance = sqrt(distance);
+    minutes = distance / rate;
+    setDoubleParam(P_VectorMoveTime, minutes * 60.0);
+
+    /* Equal times on every axis means each axis rate is its share of the vector rate.
+     * Every axis is checked against its limits before any is queued, so that a refused
+     * axis cannot leave the others moving to part of a vector. */
+    double axisRate[OXINSTIPS_VECTOR_AXES];
+    for (int i = 0; i < OXINSTIPS_VECTOR_AXES; i++) {
+        axisRate[i] = 0.0;
+        axisActive_[i] = false;
+        if (fabs(change[i]) < OXINSTIPS_VECTOR_MIN_CHANGE) continue;
+        axisRate[i] = fabs(change[i]) / minutes;
+        if (axisRate[i] < OXINSTIPS_VECTOR_MIN_RATE) axisRate[i] = OXINSTIPS_VECTOR_MIN_RATE;
+        waiters_[i].rate = axisRate[i];
+        if (axes_[i]->checkSetpointWaiter(&waiters_[i], target[i]) != asynSuccess) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: %s: axis %d refused %g T at %g T/min\n",
+                driverName, functionName, portName, i, target[i], axisRate[i]);
+            status = asynError;
+        }
+    }
+
+    state = OxInstIPSVectorDone;
+    moveFailed_ = false;
+    for (int i = 0; i < OXINSTIPS_VECTOR_AXES && status == asynSuccess; i++) {
+        if (axisRate[i] == 0.0) continue;
+        if (axes_[i]->addSetpointWaiter(&waiters_[i], target[i]) == asynSuccess) {
+            axisActive_[i] = true;
+            state = OxInstIPSVectorMoving;
+        } else {
+            status = asynError;
+        }
+    }
+    if (status != asynSuccess) {
+        /* Hold the axes already queued; their waiters complete as failed. */
+        for (int i = 0; i < OXINSTIPS_VECTOR_AXES; i++) {
+            if (axisActive_[i]) axes_[i]->cancelSetpointWaiter(&waiters_[i]);
+            axisActive_[i] = false;
+        }
+        moveFailed_ = true;
+        state = OxInstIPSVectorFailed;
+    }
+    for (int i = 0; i < OXINSTIPS_VECTOR_AXES; i++) {
+        setDoubleParam(i, P_VectorAxisRate, status == asynSuccess ? axisRate[i] : 0.0);
+        callParamCallbacks(i);
+    }
+    setIntegerParam(P_VectorState, state);
+    return status;
+}
+
+void OxInstIPSVector::monitorTask()
+{
+    for (;;) {
+        epicsEventWait(completeEvent_);
+        lock();
+        int state;
+        getIntegerParam(P_VectorState, &state);
+        if (state == OxInstIPSVectorMoving) {
+            /* The axis driver dequeues a waiter before calling axisComplete(). */
+            bool moving = false;
+            for (int i = 0; i < OXINSTIPS_VECTOR_AXES; i++) {
+                if (!axisActive_[i]) continue;
+                if (!axes_[i]->isWaiterQueued(&waiters_[i])) {
+                    axisActive_[i] = false;
+                    if (waiters_[i].failed || waiters_[i].timedOut) moveFailed_ = true;
+                } else {
+                    moving = true;
+                }
+            }
+            if (!moving) {
+                setIntegerParam(P_VectorState, moveFailed_ ? OxInstIPSVectorFailed : OxInstIPSVectorDone);
+                callParamCallbacks();
+            }
+        }
+        unlock();
+    }
+}
+
+asynStatus OxInstIPSVector::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+
+    if (function == P_VectorGo) {
+        if (value) status = startMove();
+    } else {
+        setIntegerParam(function, value);
+    }
+    callParamCallbacks();
+    return status;
+}
+
+void OxInstIPSVector::report(FILE *fp, int details)
+{
+    fprintf(fp, "OxInstIPS vector %s: axes", portName);
+    for (int i = 0; i < OXINSTIPS_VECTOR_AXES; i++) {
+        fprintf(fp, " %s%s", axes_[i] ? axes_[i]->portName : "(none)", axisActive_[i] ? "*" : "");
+    }
+    fprintf(fp, "\n");
+    asynPortDriver::report(fp, details);
+}
+
+/* Configuration routine.  Called directly, or from the iocsh function below. */
+extern "C" {
+
+int OxInstIPSVectorConfig(const char *portName, const char *xPort, const char *yPort, const char *zPort)
+{
+    const char *axisPorts[OXINSTIPS_VECTOR_AXES] = { xPort, yPort, zPort };
+    new OxInstIPSVector(portName, axisPorts);
+    return asynSuccess;
+}
+
+static const iocshArg initArg0 = { "portName", iocshArgString };
+static const iocshArg initArg1 = { "xPort", iocshArgString };
+static const iocshArg initArg2 = { "yPort", iocshArgString };
+static const iocshArg initArg3 = { "zPort", iocshArgString };
+static const iocshArg * const initArgs[] = { &initArg0, &initArg1, &initArg2, &initArg3 };
+static const iocshFuncDef initFuncDef = { "OxInstIPSVectorConfig", 4, initArgs };
+
+static void initCallFunc(const iocshArgBuf *args)
+{
+    OxInstIPSVectorConfig(args[0].sval, args[1].sval, args[2].sval, args[3].sval);
+}
+
+void OxInstIPSVectorRegister(void)
+{
+    iocshRegister(&initFuncDef, initCallFunc);
+}
+
+epicsExportRegistrar(OxInstIPSVectorRegister);
+
+}
@@ -0,0 +1,69 @@
+/* OxInstIPSVector.h
+ *
+ * Coordinated control of a vector magnet driven by three IPS units, one per axis,
+ * each configured with OxInstIPSConfig.
+ *
+ * A move takes a target field vector and a rate for the magnitude of the field change.
+ * The sweep rate of each axis is scaled by its share of the change so that all axes
+ * arrive together and the field follows a straight line between the two vectors.
+ *
+ * Configure from the IOC shell with
+ *   OxInstIPSVectorConfig(portName, xPort, yPort, zPort)
+ */
+#ifndef OxInstIPSVector_H
+#define OxInstIPSVector_H
+
+#include "asynPortDriver.h"
+#include "epicsEvent.h"
+
+#include "OxInstIPSDriver.h"
+
+#define P_VectorTargetXString   "VECTOR_TARGET_X"   /* asynFloat64 r/w, T */
+#define P_VectorTargetYString   "VECTOR_TARGET_Y"   /* asynFloat64 r/w, T */
+#define P_VectorTargetZString   "VECTOR_TARGET_Z"   /* asynFloat64 r/w, T */
+#define P_VectorRateString      "VECTOR_RATE"       /* asynFloat64 r/w, T/min */
+#define P_VectorGoString        "VECTOR_GO"         /* asynInt32 w/o */
+#define P_VectorStateString     "VECTOR_STATE"      /* asynInt32 r/o, OxInstIPSVectorState */
+#define P_VectorMoveTimeString  "VECTOR_MOVE_TIME"  /* asynFloat64 r/o, s */
+#define P_VectorAxisRateString  "VECTOR_AXIS_RATE"  /* asynFloat64 r/o, T/min, addr 0-2 = X,Y,Z */
+
+enum OxInstIPSVectorState {
+    OxInstIPSVectorIdle,
+    OxInstIPSVectorMoving,
+    OxInstIPSVectorDone,
+    OxInstIPSVectorFailed
+};
+
+#define OXINSTIPS_VECTOR_AXES 3
+
+class OxInstIPSVector : public asynPortDriver {
+public:
+    OxInstIPSVector(const char *portName, const char *axisPorts[OXINSTIPS_VECTOR_AXES]);
+
+    virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    virtual void report(FILE *fp, int details);
+
+    void monitorTask();
+
+protected:
+    int P_VectorTargetX;
+    int P_VectorTargetY;
+    int P_VectorTargetZ;
+    int P_VectorRate;
+    int P_VectorGo;
+    int P_VectorState;
+    int P_VectorMoveTime;
+    int P_VectorAxisRate;
+
+private:
+    static void axisComplete(OxInstIPSWaiter *waiter);
+    asynStatus startMove();
+
+    OxInstIPSDriver *axes_[OXINSTIPS_VECTOR_AXES];
+    OxInstIPSWaiter waiters_[OXINSTIPS_VECTOR_AXES];
+    bool axisActive_[OXINSTIPS_VECTOR_AXES];
+    bool moveFailed_;
+    epicsEventId completeEvent_;
+};
+
+#endif /* OxInstIPSVector_H */
@@ -0,0 +1,188 @@
+/* devOxInstIPSWait.cpp
+ *
+ * Asynchronous device support for records that complete when an OxInstIPSDriver
+ * condition is met, so that a put with callback (e.g. from sscan) only returns
+ * once the magnet is ready.
+ *
+ *   record(bo, "$(P)SETTLE:WAIT") {
+ *       field(DTYP, "OxInstIPS Settle Wait")
+ *       field(OUT,  "@$(PORT)")
+ *   }
+ *
+ * Writing 1 completes once the field has settled on samples taken after the write,
+ * or with a TIMEOUT alarm after the driver's SETTLE_TIMEOUT.  Writing 0 completes
+ * immediately.
+ *
+ *   record(ao, "$(P)FIELD:SP:WAIT") {
+ *       field(DTYP, "OxInstIPS Setpoint Wait")
+ *       field(OUT,  "@$(PORT) FIELD")
+ *   }
+ *
+ * Writing a value sends it as the field (FIELD) or current (CURRENT) setpoint followed
+ * by "To Set Point", and completes once the demand is at rest on the target.  Adding
+ * SETTLE to the link, e.g. "@$(PORT) FIELD SETTLE", also waits for the field to settle.
+ * The record completes with a WRITE alarm if the IPS rejects the command or the
+ * activity is changed during the move, and a TIMEOUT alarm after MOVE_TIMEOUT.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alarm.h"
+#include "callback.h"
+#include "dbAccess.h"
+#include "dbDefs.h"
+#include "devSup.h"
+#include "recGbl.h"
+#include "aoRecord.h"
+#include "boRecord.h"
+
+#include "OxInstIPSDriver.h"
+
+#include "epicsExport.h"
+
+/* Look up the driver named by an INST_IO link of the form "@portName [options]".
+ * The options, if any, are copied to the options buffer. */
+static OxInstIPSDriver *findDriver(dbCommon *prec, const DBLINK *plink, char *options, size_t optionsSize)
+{
+    char portName[64];
+    const char *link;
+    size_t length;
+    asynPortDriver *pDriver;
+
+    if (plink->type != INST_IO) {
+        recGblRecordError(S_dev_badOutType, (void *)prec, "devOxInstIPSWait: OUT must be INST_IO");
+        return NULL;
+    }
+    link = plink->value.instio.string;
+    link += strspn(link, " ");
+    length = strcspn(link, " ");
+    if (length >= sizeof(portName)) length = sizeof(portName) - 1;
+    memcpy(portName, link, length);
+    portName[length] = '\0';
+    if (options != NULL) {
+        link += length;
+        link += strspn(link, " ");
+        strncpy(options, link, optionsSize - 1);
+        options[optionsSize - 1] = '\0';
+    }
+    pDriver = static_cast<asynPortDriver *>(findAsynPortDriver(portName));
+    OxInstIPSDriver *pIPS = dynamic_cast<OxInstIPSDriver *>(pDriver);
+    if (pIPS == NULL) {
+        recGblRecordError(S_dev_noDeviceFound, (void *)prec, "devOxInstIPSWait: no OxInstIPS port");
+    }
+    return pIPS;
+}
+
+static long initBoSettleWait(boRecord *prec)
+{
+    OxInstIPSDriver *pIPS = findDriver((dbCommon *)prec, &prec->out, NULL, 0);
+    if (pIPS == NULL) return S_dev_noDeviceFound;
+
+    OxInstIPSWaiter *waiter = new OxInstIPSWaiter();
+    waiter->precord = (dbCommon *)prec;
+    waiter->driver = pIPS;
+    waiter->condition = OxInstIPSWaitSettle;
+    prec->dpvt = waiter;
+    return 2;
+}
+
+static long writeBoSettleWait(boRecord *prec)
+{
+    OxInstIPSWaiter *waiter = static_cast<OxInstIPSWaiter *>(prec->dpvt);
+
+    if (waiter == NULL) return -1;
+    if (prec->pact) {
+        /* Second pass, requested by the driver once the wait is over. */
+        if (waiter->timedOut) recGblSetSevr(prec, TIMEOUT_ALARM, INVALID_ALARM);
+        return 0;
+    }
+    if (prec->val == 0) return 0;
+    if (waiter->driver->addSettleWaiter(waiter) != asynSuccess) {
+        recGblSetSevr(prec, WRITE_ALARM, INVALID_ALARM);
+        return -1;
+    }
+    prec->pact = TRUE;
+    return 0;
+}
+
+static long initAoSetpointWait(aoRecord *prec)
+{
+    char options[32];
+    OxInstIPSDriver *pIPS = findDriver((dbCommon *)prec, &prec->out, options, sizeof(options));
+    if (pIPS == NULL) return S_dev_noDeviceFound;
+
+    OxInstIPSWaiter *waiter = new OxInstIPSWaiter();
+    waiter->precord = (dbCommon *)prec;
+    waiter->driver = pIPS;
+    if (strncmp(options, "FIELD", 5) == 0) {
+        waiter->condition = OxInstIPSWaitFieldTarget;
+    } else if (strncmp(options, "CURRENT", 7) == 0) {
+        waiter->condition = OxInstIPSWaitCurrentTarget;
+    } else {
+        recGblRecordError(S_dev_badOutType, (void *)prec,
+                          "devOxInstIPSWait: OUT must be @port FIELD|CURRENT [SETTLE]");
+        delete waiter;
+        return S_dev_badOutType;
+    }
+    waiter->settle = (strstr(options, "SETTLE") != NULL);
+    prec->dpvt = waiter;
+    return 2;
+}
+
+static long writeAoSetpointWait(aoRecord *prec)
+{
+    OxInstIPSWaiter *waiter = static_cast<OxInstIPSWaiter *>(prec->dpvt);
+
+    if (waiter == NULL) return -1;
+    if (prec->pact) {
+        if (waiter->failed) recGblSetSevr(prec, WRITE_ALARM, INVALID_ALARM);
+        else if (waiter->timedOut) recGblSetSevr(prec, TIMEOUT_ALARM, INVALID_ALARM);
+        return 0;
+    }
+    if (waiter->driver->addSetpointWaiter(waiter, prec->oval) != asynSuccess) {
+        recGblSetSevr(prec, WRITE_ALARM, INVALID_ALARM);
+        return -1;
+    }
+    prec->pact = TRUE;
+    return 0;
+}
+
+struct {
+    long number;
+    DEVSUPFUN report;
+    DEVSUPFUN init;
+    DEVSUPFUN init_record;
+    DEVSUPFUN get_ioint_info;
+    DEVSUPFUN write_bo;
+} devBoOxInstIPSSettleWait = {
+    5,
+    NULL,
+    NULL,
+    (DEVSUPFUN)initBoSettleWait,
+    NULL,
+    (DEVSUPFUN)writeBoSettleWait
+};
+
+struct {
+    long number;
+    DEVSUPFUN report;
+    DEVSUPFUN init;
+    DEVSUPFUN init_record;
+    DEVSUPFUN get_ioint_info;
+    DEVSUPFUN write_ao;
+    DEVSUPFUN special_linconv;
+} devAoOxInstIPSSetpointWait = {
+    6,
+    NULL,
+    NULL,
+    (DEVSUPFUN)initAoSetpointWait,
+    NULL,
+    (DEVSUPFUN)writeAoSetpointWait,
+    NULL
+};
+
+extern "C" {
+epicsExportAddress(dset, devBoOxInstIPSSettleWait);
+epicsExportAddress(dset, devAoOxInstIPSSetpointWait);
+}
@@ -0,0 +1,181 @@
+/* OxInstIPSCodecTest.cpp
+ *
+ * Samples must come back from the codec, and from a history file written, closed and
+ * reopened, exactly as they went in.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "epicsTime.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#include "OxInstIPSCodec.h"
+#include "OxInstIPSHistory.h"
+
+/* A ramp to a set point and back with noise, the odd failed read and status change. */
+static void makeSamples(std::vector<OxInstIPSHistorySample> *samples, size_t count, epicsUInt64 start)
+{
+    epicsUInt32 seed = 97531;
+
+    samples->resize(count);
+    for (size_t n = 0; n < count; n++) {
+        OxInstIPSHistorySample &s = (*samples)[n];
+        double current = 50.0 * sin(n * 0.001);
+
+        seed = seed * 1664525u + 1013904223u;
+        memset(&s, 0, sizeof(s));
+        s.time = start + n * 500000000ull + (seed >> 24) * 1000ull;
+        s.values[0] = floor(current * 10000.0 + 0.5) / 10000.0;
+        s.values[1] = floor((current + ((seed >> 8) % 100) * 0.0001) * 1000.0 + 0.5) / 1000.0;
+        s.values[2] = floor(current * 0.05 * 10000.0 + 0.5) / 10000.0;
+        s.values[3] = 120.0;
+        s.values[4] = 0.5;
+        s.values[5] = floor(current * 0.1 * 100000.0 + 0.5) / 100000.0;
+        s.values[6] = -9.87654;
+        s.values[7] = 0.05;
+        if ((seed >> 8) % 500 == 0) s.values[1] = NAN;
+        s.statusValid = (seed >> 8) % 700 != 0;
+        s.status[0] = (epicsUInt8)(n / 300 % 3);
+        s.status[2] = 1;
+        s.status[3] = 3;
+        s.status[6] = current > 0.0 ? 1 : 0;
+    }
+}
+
+static bool sameSample(const OxInstIPSHistorySample &a, const OxInstIPSHistorySample &b)
+{
+    if (a.time != b.time || a.statusValid != b.statusValid) return false;
+    for (int i = 0; i < OXINSTIPS_HISTORY_VALUES; i++) {
+        if (isnan(a.values[i]) != isnan(b.values[i])) return false;
+        if (!isnan(a.values[i]) && a.values[i] != b.values[i]) return false;
+    }
+    return !a.statusValid || memcmp(a.status, b.status, sizeof(a.status)) == 0;
+}
+
+/* Encodes samples in runs of a history block, as the history file does, and decodes them. */
+static void testRoundTrip(const std::vector<OxInstIPSHistorySample> &samples, const char *what)
+{
+    std::vector<unsigned char> buffer(samples.size() * OXINSTIPS_CODEC_MAX_BYTES);
+    OxInstIPSSampleEncoder encoder;
+    OxInstIPSSampleDecoder decoder;
+    size_t bytes = 0, longest = 0, offset = 0, mismatches = 0;
+
+    for (size_t n = 0; n < samples.size(); n++) {
+        if (n % OXINSTIPS_HISTORY_BLOCK_SAMPLES == 0) encoder.reset(samples[n].time);
+        size_t used = encoder.encode(samples[n], &buffer[bytes]);
+        if (used > longest) longest = used;
+        bytes += used;
+    }
+    testOk(longest <= OXINSTIPS_CODEC_MAX_BYTES, "%s: longest encoding %lu bytes", what, (unsigned long)longest);
+
+    for (size_t n = 0; n < samples.size(); n++) {
+        OxInstIPSHistorySample decoded;
+        if (n % OXINSTIPS_HISTORY_BLOCK_SAMPLES == 0) decoder.reset(samples[n].time);
+        size_t used = decoder.decode(&buffer[offset], bytes - offset, &decoded);
+        if (used == 0 || !sameSample(samples[n], decoded)) {
+            if (mismatches++ < 10) testDiag("sample %lu differs", (unsigned long)n);
+            if (used == 0) break;
+        }
+        offset += used;
+    }
+    testOk(mismatches == 0 && offset == bytes, "%s: %lu samples round trip in %lu bytes",
+           what, (unsigned long)samples.size(), (unsigned long)bytes);
+}
+
+/* Full scale values, all reads failed and a large time step. */
+static void testExtremes()
+{
+    std::vector<OxInstIPSHistorySample> samples(4);
+
+    memset(&samples[0], 0, samples.size() * sizeof(OxInstIPSHistorySample));
+    for (int i = 0; i < OXINSTIPS_HISTORY_VALUES; i++) {
+        samples[0].values[i] = 99999.99999;
+        samples[1].values[i] = -99999.99999;
+        samples[2].values[i] = NAN;
+        samples[3].values[i] = 0.00001;
+    }
+    samples[0].time = 1000000000ull;
+    samples[1].time = 1000000001ull;
+    samples[2].time = 1000000001ull;
+    samples[3].time = 4000000000000000000ull;
+    samples[3].statusValid = 1;
+    memset(samples[3].status, 9, sizeof(samples[3].status));
+    testRoundTrip(samples, "extremes");
+}
+
+/* Every prefix of an encoding is too short to decode. */
+static void testTruncated()
+{
+    std::vector<OxInstIPSHistorySample> samples;
+    unsigned char buffer[OXINSTIPS_CODEC_MAX_BYTES];
+    OxInstIPSSampleEncoder encoder;
+    OxInstIPSSampleDecoder decoder;
+    OxInstIPSHistorySample decoded;
+    int decodedShort = 0;
+
+    makeSamples(&samples, 1, 0);
+    samples[0].statusValid = 1;
+    encoder.reset(samples[0].time);
+    size_t bytes = encoder.encode(samples[0], buffer);
+    for (size_t size = 0; size < bytes; size++) {
+        decoder.reset(samples[0].time);
+        if (decoder.decode(buffer, size, &decoded) != 0) decodedShort++;
+    }
+    testOk(decodedShort == 0, "no prefix of a %lu byte encoding decodes", (unsigned long)bytes);
+}
+
+/* Written through the history file, closed, reopened and read back. */
+static void testHistoryFile(const std::vector<OxInstIPSHistorySample> &samples)
+{
+    char fileName[64];
+    OxInstIPSHistory history;
+    std::vector<double> times, values;
+    epicsTimeStamp now, start, end;
+    size_t appended = 0, mismatches = 0;
+
+    epicsTimeGetCurrent(&now);
+    sprintf(fileName, "OxInstIPSCodecTest.%lu.%lu.hist", (unsigned long)now.secPastEpoch, (unsigned long)now.nsec);
+    testOk(history.open(fileName), "open %s", fileName);
+    for (size_t n = 0; n < samples.size(); n++) {
+        if (history.append(samples[n])) appended++;
+    }
+    history.close();
+    testOk(history.open(fileName), "reopen");
+    testOk(appended == samples.size() && history.count() == samples.size(),
+           "%lu samples after reopen", (unsigned long)history.count());
+
+    start.secPastEpoch = 0;
+    start.nsec = 0;
+    end.secPastEpoch = 0xffffffff;
+    end.nsec = 0;
+    history.query(0, start, end, 1, samples.size(), &times, &values);
+    for (size_t n = 0; n < values.size(); n++) {
+        if (values[n] != samples[n].values[0]) mismatches++;
+    }
+    testOk(values.size() == samples.size() && mismatches == 0, "R0 read back from the file");
+    history.close();
+
+    remove(fileName);
+    for (int level = 0; level < 4; level++) {
+        char levelName[72];
+        sprintf(levelName, "%s.L%d", fileName, level);
+        remove(levelName);
+    }
+}
+
+MAIN(OxInstIPSCodecTest)
+{
+    std::vector<OxInstIPSHistorySample> samples;
+
+    testPlan(9);
+    makeSamples(&samples, 100000, 1000000000000000000ull);
+    testRoundTrip(samples, "ramp");
+    testExtremes();
+    testTruncated();
+    samples.resize(1000);
+    testHistoryFile(samples);
+    return testDone();
+}
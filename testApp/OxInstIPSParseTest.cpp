@@ -0,0 +1,103 @@
+/* OxInstIPSParseTest.cpp
+ *
+ * The R reply parser must return exactly what strtod does, for the replies the IPS sends
+ * and for anything else that arrives on the line.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "epicsTypes.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#include "OxInstIPSParse.h"
+
+/* Parses line with strtod, OxInstIPSParseNumber and a batch of one, bit for bit. */
+static bool sameAsStrtod(const char *line)
+{
+    char *end;
+    double scalar = strtod(line, &end), fast = 0.0, batch = 0.0;
+    bool scalarOk = (end != line);
+    bool fastOk = OxInstIPSParseNumber(line, &fast);
+    bool batchOk = false;
+
+    OxInstIPSParseBatch(&line, 1, &batch, &batchOk);
+    if (fastOk != scalarOk || batchOk != scalarOk) return false;
+    return !scalarOk || (memcmp(&fast, &scalar, sizeof(double)) == 0 &&
+                         memcmp(&batch, &scalar, sizeof(double)) == 0);
+}
+
+static const char *cases[] = {
+    "", "+", "-", ".", "+.", "-0", "-0.000", "0", "00012.5", "12.", ".5", "+12.3456",
+    "-99.9999", "+120.00000", "0.0000000000000000000001", "0.00000000000000000000001", "1e3",
+    "1.5E-2", "0x10", " 5", "inf", "nan", "123456789012345", "1234567890123456",
+    "9007199254740993", "12.34.56", "1.2R", "R1.2", "-.", "000000000000000000000000001.5"
+};
+#define NUM_CASES (sizeof(cases) / sizeof(cases[0]))
+
+static void testCases()
+{
+    for (size_t i = 0; i < NUM_CASES; i++) {
+        testOk(sameAsStrtod(cases[i]), "\"%s\" parses as strtod", cases[i]);
+    }
+}
+
+static void testFuzz()
+{
+    static const char alphabet[] = "0123456789000..+-eEx ";
+    char line[24];
+    epicsUInt32 seed = 2468;
+    int mismatches = 0;
+
+    for (int i = 0; i < 100000; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        size_t length = (seed >> 8) % (sizeof(line) - 1);
+        for (size_t c = 0; c < length; c++) {
+            seed = seed * 1664525u + 1013904223u;
+            line[c] = alphabet[(seed >> 8) % (sizeof(alphabet) - 1)];
+        }
+        line[length] = '\0';
+        if (!sameAsStrtod(line)) {
+            if (mismatches++ < 10) testDiag("mismatch on \"%s\"", line);
+        }
+    }
+    testOk(mismatches == 0, "100000 random lines parse as strtod (%d mismatches)", mismatches);
+}
+
+/* A batch longer than a chunk gives the same results as parsing the lines one by one. */
+static void testBatch()
+{
+    static const char *formats[] = { "%+.4f", "%+.3f", "%.2f", "%+.5f" };
+    char text[200][24];
+    const char *lines[200];
+    double values[200];
+    bool ok[200];
+    epicsUInt32 seed = 12345;
+    int mismatches = 0;
+
+    for (size_t i = 0; i < 200; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        double value = ((seed >> 8) / (double)(1u << 24) - 0.5) * 240.0;
+        sprintf(text[i], formats[i % 4], value);
+        lines[i] = text[i];
+    }
+    strcpy(text[17], "?R5");
+    size_t parsed = OxInstIPSParseBatch(lines, 200, values, ok);
+    for (size_t i = 0; i < 200; i++) {
+        double single = 0.0;
+        bool singleOk = OxInstIPSParseNumber(lines[i], &single);
+        if (singleOk != ok[i] || (ok[i] && memcmp(&single, &values[i], sizeof(double)) != 0)) mismatches++;
+    }
+    testOk(mismatches == 0, "batch of 200 matches single parses");
+    testOk(parsed == 199 && !ok[17], "batch counts the line that is not a number");
+}
+
+MAIN(OxInstIPSParseTest)
+{
+    testPlan((int)NUM_CASES + 3);
+    testCases();
+    testFuzz();
+    testBatch();
+    return testDone();
+}
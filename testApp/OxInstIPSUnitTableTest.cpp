@@ -0,0 +1,63 @@
+/* OxInstIPSUnitTableTest.cpp
+ *
+ * The unit table keeps each parameter of all units in one contiguous column, and its
+ * overview pass must give the same results as the same pass over one structure per
+ * unit.
+ */
+#include <stdio.h>
+
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#include "OxInstIPSUnitTable.h"
+
+#define TEST_UNITS 37
+
+static void testColumns()
+{
+    OxInstIPSUnitTable &table = OxInstIPSUnitTable::instance();
+    size_t first = 0;
+    int notContiguous = 0, notDefault = 0;
+
+    for (int u = 0; u < TEST_UNITS; u++) {
+        char port[16];
+        sprintf(port, "IPS%d", u);
+        size_t unit = table.addUnit(port);
+        if (u == 0) first = unit;
+        else if (unit != first + u) notContiguous++;
+    }
+    testOk(notContiguous == 0, "units get consecutive slots");
+
+    table.lock();
+    testOk(table.units() == first + TEST_UNITS, "%lu units", (unsigned long)table.units());
+    testOk(table.port(first + 5) == "IPS5", "port of a slot");
+    for (size_t p = 0; p < OXINSTIPS_UNIT_PARAMS; p++) {
+        for (size_t u = 0; u < table.units(); u++) {
+            if (table.values(p) + u != &table.value(p, u) || table.valids(p) + u != &table.valid(p, u) ||
+                table.stales(p) + u != &table.stale(p, u)) notContiguous++;
+            if (table.value(p, u) != 0.0 || table.valid(p, u) != 0.0 || table.stale(p, u) != 0.0) notDefault++;
+        }
+    }
+    for (size_t u = 0; u < table.units(); u++) {
+        if (table.faults() + u != &table.fault(u)) notContiguous++;
+        if (table.fault(u) != -1.0) notDefault++;
+    }
+    testOk(notContiguous == 0, "each parameter is one contiguous column");
+    testOk(notDefault == 0, "new units are not valid and have no fault");
+    table.unlock();
+}
+
+static void testLayouts()
+{
+    testOk(OxInstIPSUnitLayoutsAgree(1, 100), "overview agrees for 1 unit");
+    testOk(OxInstIPSUnitLayoutsAgree(TEST_UNITS, 100), "overview agrees for %d units", TEST_UNITS);
+    testOk(OxInstIPSUnitLayoutsAgree(1000, 40), "overview agrees for 1000 units");
+}
+
+MAIN(OxInstIPSUnitTableTest)
+{
+    testPlan(8);
+    testColumns();
+    testLayouts();
+    return testDone();
+}